@@ -0,0 +1,724 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Microbenchmark for the discordcrypto element.
+ *
+ * Pushes synthetic opus rtp packets of 20, 40 and 60 ms frames through the
+ * element for every encryption pattern and reports packets per second, ns per
+ * packet and allocations per packet. An identity element is run the same way
+ * first so the harness overhead can be subtracted.
+ *
+ *   make bench BENCH_ARGS="--packets=50000 --max-ns=2000"
+ *
+ * --max-ns and --max-allocs make the run exit with a failure when any pattern
+ * costs more than the given amount over the baseline, to catch regressions.
+ *
+ * --list-size pushes buffer lists instead of single buffers, which is what
+ * --vectorized needs to make a difference. --keystream-ring computes the
+ * keystream ahead of time.
+ *
+ * --startup times the whole life of an element instead: create it, set the
+ * key, negotiate caps, encrypt one packet and tear it down again, the way a
+ * voice connection does.
+ *
+ * --validate is a differential fuzzer instead: random packets of random
+ * lengths, with and without csrcs and header extensions, go through the
+ * reference path (one contiguous buffer at a time, nothing enabled) and
+ * through every fast path. The encrypted bytes have to match the reference
+ * exactly, suffix packets carry random nonces and are decrypted instead.
+ * The throughput of every path is printed along with it. --seed picks
+ * other packets.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/check/gstharness.h>
+
+#define RTP_HEADER_SIZE 12
+// room left behind every packet, as rtpopuspay would after allocation negotiation
+#define TRAILER_PADDING 40
+#define WARMUP_PACKETS 1000
+// ring used by --validate, and the pause that lets it keep up
+#define VALIDATE_RING (64 * 1024)
+#define VALIDATE_PAUSE_US 200
+#define FUZZ_MAX_PAYLOAD 400
+
+#define BENCH_CAPS "application/x-rtp, media = (string) audio, payload = (int) 120, " \
+    "clock-rate = (int) 48000, encoding-params = (string) 2, encoding-name = (string) OPUS"
+
+#ifdef __GLIBC__
+// every allocation in the process goes through here, glibc exports the real allocator
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static gint allocations;
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&allocations);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  g_atomic_int_inc (&allocations);
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  g_atomic_int_inc (&allocations);
+  return __libc_realloc (ptr, size);
+}
+
+#define ALLOCATIONS() g_atomic_int_get (&allocations)
+#else
+#define ALLOCATIONS() 0
+#endif
+
+typedef struct {
+  guint duration;
+  guint min_size;
+  guint max_size;
+} BenchFrame;
+
+// opus payload sizes seen from opusenc at voice bitrates
+static const BenchFrame frames[] = {
+  { 20, 20, 160 },
+  { 40, 40, 280 },
+  { 60, 60, 400 },
+};
+
+typedef struct {
+  gdouble ns_per_packet;
+  gdouble allocs_per_packet;
+} BenchResult;
+
+static gint packets = 20000;
+static gchar *plugin = NULL;
+static gint max_ns = -1;
+static gdouble max_allocs = -1;
+static gboolean unpadded = FALSE;
+static gint list_size = 1;
+static gboolean vectorized = FALSE;
+static gboolean validate = FALSE;
+static gint keystream_ring = 0;
+static gint seed = 1;
+static gint startup = 0;
+
+// how packets are handed to the element and which fast paths it may use
+typedef struct {
+  const gchar *name;
+  gboolean vectorized;
+  gint keystream_ring;
+  guint workers;
+  gint list_size;
+  // header and payload in memories of their own, as rtpopuspay does
+  gboolean scatter;
+  // no room left for the trailer
+  gboolean unpadded;
+  // leave the keystream thread time to keep up
+  gboolean paced;
+} BenchPath;
+
+// the first one is the reference the others are compared against, lists
+// are odd sized so vectorized batches are left half full
+static const BenchPath paths[] = {
+  { "reference", FALSE, 0, 0, 1, FALSE, FALSE, FALSE },
+  { "buffer-list", FALSE, 0, 0, 7, FALSE, FALSE, FALSE },
+  { "vectorized", TRUE, 0, 0, 7, FALSE, FALSE, FALSE },
+  { "keystream-ring", FALSE, VALIDATE_RING, 0, 1, FALSE, FALSE, TRUE },
+  { "scatter-gather", FALSE, 0, 0, 1, TRUE, FALSE, FALSE },
+  { "unpadded", FALSE, 0, 0, 1, FALSE, TRUE, FALSE },
+  { "workers", FALSE, 0, 1, 7, FALSE, FALSE, FALSE },
+};
+
+static GOptionEntry entries[] = {
+  { "packets", 'n', 0, G_OPTION_ARG_INT, &packets, "Packets per run", "N" },
+  { "plugin", 'p', 0, G_OPTION_ARG_FILENAME, &plugin, "Plugin file to load", "PATH" },
+  { "max-ns", 0, 0, G_OPTION_ARG_INT, &max_ns, "Fail if a pattern costs more ns per packet than the baseline", "NS" },
+  { "max-allocs", 0, 0, G_OPTION_ARG_DOUBLE, &max_allocs, "Fail if a pattern allocates more per packet than the baseline", "N" },
+  { "unpadded", 0, 0, G_OPTION_ARG_NONE, &unpadded, "Push packets without room for the trailer", NULL },
+  { "list-size", 'l', 0, G_OPTION_ARG_INT, &list_size, "Push buffer lists of this many packets", "N" },
+  { "vectorized", 0, 0, G_OPTION_ARG_NONE, &vectorized, "Encrypt buffer lists with the vectorized kernel", NULL },
+  { "keystream-ring", 0, 0, G_OPTION_ARG_INT, &keystream_ring, "Bytes of keystream to compute ahead", "BYTES" },
+  { "startup", 0, 0, G_OPTION_ARG_INT, &startup, "Time this many element startups and teardowns instead of packets", "N" },
+  { "validate", 0, 0, G_OPTION_ARG_NONE, &validate, "Compare every fast path against the reference path with random packets", NULL },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed of the random packets of --validate", "N" },
+  { NULL }
+};
+
+static GstBuffer **
+bench_packets (const BenchFrame *frame, guint count)
+{
+  GstBuffer **bufs = g_new (GstBuffer *, count);
+  GRand *rand = g_rand_new_with_seed (frame->duration);
+  GstAllocationParams params;
+  guint i, j;
+
+  gst_allocation_params_init (&params);
+  if (!unpadded)
+    params.padding = TRAILER_PADDING;
+
+  for (i = 0; i < count; i++) {
+    gsize payload = g_rand_int_range (rand, frame->min_size, frame->max_size + 1);
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, RTP_HEADER_SIZE + payload, &params);
+    GstMapInfo map;
+
+    gst_buffer_map (buf, &map, GST_MAP_WRITE);
+    map.data[0] = 0x80;
+    map.data[1] = 120;
+    GST_WRITE_UINT16_BE (map.data + 2, i);
+    GST_WRITE_UINT32_BE (map.data + 4, i * frame->duration * 48);
+    GST_WRITE_UINT32_BE (map.data + 8, 0x1234);
+    for (j = RTP_HEADER_SIZE; j < map.size; j++)
+      map.data[j] = g_rand_int (rand);
+    gst_buffer_unmap (buf, &map);
+
+    bufs[i] = buf;
+  }
+
+  g_rand_free (rand);
+  return bufs;
+}
+
+static void
+bench_set_key (GstElement *element)
+{
+  GValue key = G_VALUE_INIT;
+  GValue byte = G_VALUE_INIT;
+  guint i;
+
+  g_value_init (&key, GST_TYPE_ARRAY);
+  g_value_init (&byte, G_TYPE_UINT);
+  for (i = 0; i < 32; i++) {
+    g_value_set_uint (&byte, i * 7 + 1);
+    gst_value_array_append_value (&key, &byte);
+  }
+
+  g_object_set_property (G_OBJECT (element), "key", &key);
+  g_value_unset (&byte);
+  g_value_unset (&key);
+}
+
+// path is NULL for elements other than discordcrypto
+static GstHarness *
+bench_harness (const gchar *name, gint encryption, const BenchPath *path)
+{
+  GstElement *element = gst_element_factory_make (name, NULL);
+  GstHarness *h;
+
+  // set before the harness starts the element, the ring and the workers
+  // are set up on start
+  if (encryption >= 0) {
+    g_object_set (element, "encryption", encryption, NULL);
+    bench_set_key (element);
+  }
+  if (encryption >= 0 && path) {
+    g_object_set (element, "vectorized", path->vectorized,
+        "keystream-ring", (guint) MAX (path->keystream_ring, 0),
+        "workers", path->workers, NULL);
+  }
+  h = gst_harness_new_with_element (element, "sink", "src");
+  gst_object_unref (element);
+  gst_harness_set_src_caps_str (h, BENCH_CAPS);
+
+  return h;
+}
+
+// pushes n packets as one buffer list, or as a single buffer for n == 1
+static GstFlowReturn
+bench_push (GstHarness *h, GstBuffer **bufs, guint n)
+{
+  GstBufferList *list;
+  guint i;
+
+  if (n == 1)
+    return gst_harness_push (h, bufs[0]);
+
+  list = gst_buffer_list_new_sized (n);
+  for (i = 0; i < n; i++)
+    gst_buffer_list_add (list, bufs[i]);
+
+  return gst_pad_push_list (h->srcpad, list);
+}
+
+// encryption < 0 runs the element without touching its properties
+static gboolean
+bench_run (const gchar *name, gint encryption, const BenchFrame *frame, BenchResult *result)
+{
+  guint count = WARMUP_PACKETS + packets;
+  GstBuffer **bufs = bench_packets (frame, count);
+  BenchPath path = { "", vectorized, keystream_ring, 0, list_size, FALSE, unpadded, FALSE };
+  GstHarness *h = bench_harness (name, encryption, &path);
+  GstClockTime start = 0;
+  gint allocs = 0;
+  guint timed = 0;
+  gboolean ok = TRUE;
+  guint i, j, n;
+
+  for (i = 0; i < count; i += n) {
+    n = MIN ((guint) list_size, count - i);
+
+    if (i >= WARMUP_PACKETS && timed == 0) {
+      timed = count - i;
+      allocs = ALLOCATIONS ();
+      start = gst_util_get_timestamp ();
+    }
+
+    ok = bench_push (h, bufs + i, n) == GST_FLOW_OK;
+    for (j = 0; ok && j < n; j++) {
+      GstBuffer *out = gst_harness_try_pull (h);
+      ok = out != NULL;
+      if (out)
+        gst_buffer_unref (out);
+    }
+
+    if (!ok) {
+      g_printerr ("%s: packet %u was not passed through\n", name, i + j);
+      // the rest were never handed to the harness
+      for (i += n; i < count; i++)
+        gst_buffer_unref (bufs[i]);
+      break;
+    }
+  }
+
+  if (ok) {
+    result->ns_per_packet = (gdouble) GST_CLOCK_DIFF (start, gst_util_get_timestamp ()) / timed;
+    result->allocs_per_packet = (gdouble) (ALLOCATIONS () - allocs) / timed;
+  }
+
+  gst_harness_teardown (h);
+  g_free (bufs);
+  return ok;
+}
+
+// a pipeline per voice connection, the first packet is part of the startup
+static gboolean
+bench_startup (const gchar *name, gint encryption, BenchResult *result)
+{
+  BenchFrame frame = { 20, 80, 80 };
+  GstBuffer **bufs = bench_packets (&frame, startup);
+  BenchPath path = { "", vectorized, keystream_ring, 0, 1, FALSE, unpadded, FALSE };
+  GstClockTime start = gst_util_get_timestamp ();
+  gint allocs = ALLOCATIONS ();
+  gboolean ok = TRUE;
+  gint i;
+
+  for (i = 0; i < startup; i++) {
+    GstHarness *h = bench_harness (name, encryption, &path);
+    GstBuffer *out = NULL;
+
+    if (ok && gst_harness_push (h, bufs[i]) == GST_FLOW_OK)
+      out = gst_harness_try_pull (h);
+    else
+      gst_buffer_unref (bufs[i]);
+
+    if (ok && !out) {
+      g_printerr ("%s: no packet came out of startup %d\n", name, i);
+      ok = FALSE;
+    }
+    if (out)
+      gst_buffer_unref (out);
+    gst_harness_teardown (h);
+  }
+
+  if (ok) {
+    result->ns_per_packet = (gdouble) GST_CLOCK_DIFF (start, gst_util_get_timestamp ()) / startup;
+    result->allocs_per_packet = (gdouble) (ALLOCATIONS () - allocs) / startup;
+  }
+
+  g_free (bufs);
+  return ok;
+}
+
+static GstBuffer *
+bench_fuzz_packet (GRand *rand, guint i, gboolean rtpsize, const BenchPath *path)
+{
+  guint cc = g_rand_boolean (rand) ? g_rand_int_range (rand, 1, 4) : 0;
+  gboolean ext = g_rand_boolean (rand);
+  guint ext_words = ext ? g_rand_int_range (rand, 0, 4) : 0;
+  gsize header = RTP_HEADER_SIZE + cc * 4 + (ext ? 4 + ext_words * 4 : 0);
+  gsize size = header + g_rand_int_range (rand, 0, FUZZ_MAX_PAYLOAD + 1);
+  // what each mode sends in the clear
+  gsize clear = rtpsize ? RTP_HEADER_SIZE + cc * 4 + (ext ? 4 : 0) : RTP_HEADER_SIZE;
+  guint8 *data = g_malloc (size);
+  GstAllocationParams params;
+  GstBuffer *buf;
+  gsize j;
+
+  for (j = RTP_HEADER_SIZE; j < size; j++)
+    data[j] = g_rand_int (rand);
+  data[0] = 0x80 | (ext ? 0x10 : 0) | cc;
+  data[1] = 120;
+  GST_WRITE_UINT16_BE (data + 2, i);
+  GST_WRITE_UINT32_BE (data + 4, i * 960);
+  GST_WRITE_UINT32_BE (data + 8, 0x1234);
+  if (ext) {
+    GST_WRITE_UINT16_BE (data + RTP_HEADER_SIZE + cc * 4, 0xBEDE);
+    GST_WRITE_UINT16_BE (data + RTP_HEADER_SIZE + cc * 4 + 2, ext_words);
+  }
+
+  gst_allocation_params_init (&params);
+  if (!path->unpadded)
+    params.padding = TRAILER_PADDING;
+
+  if (path->scatter) {
+    buf = gst_buffer_new_allocate (NULL, clear, NULL);
+    gst_buffer_append_memory (buf, gst_allocator_alloc (NULL, size - clear, &params));
+    gst_buffer_fill (buf, 0, data, clear);
+    gst_buffer_fill (buf, clear, data + clear, size - clear);
+  } else {
+    buf = gst_buffer_new_allocate (NULL, size, &params);
+    gst_buffer_fill (buf, 0, data, size);
+  }
+
+  g_free (data);
+  return buf;
+}
+
+// the same packets for every path, only their memory layout differs
+static GstBuffer **
+bench_fuzz_packets (gboolean rtpsize, const BenchPath *path)
+{
+  GstBuffer **bufs = g_new (GstBuffer *, packets);
+  GRand *rand = g_rand_new_with_seed (seed);
+  gint i;
+
+  for (i = 0; i < packets; i++)
+    bufs[i] = bench_fuzz_packet (rand, i, rtpsize, path);
+
+  g_rand_free (rand);
+  return bufs;
+}
+
+// the packets as they come out of the element along path, NULL if any of
+// them didn't
+static GBytes **
+bench_fuzz_run (const GEnumValue *pattern, const BenchPath *path, gdouble *ns_per_packet)
+{
+  gboolean rtpsize = g_str_has_suffix (pattern->value_nick, "_rtpsize");
+  GstBuffer **bufs = bench_fuzz_packets (rtpsize, path);
+  GstHarness *h = bench_harness ("discordcrypto", pattern->value, path);
+  GBytes **out = g_new0 (GBytes *, packets);
+  GstClockTime start = gst_util_get_timestamp (), paused = 0;
+  gboolean ok = TRUE;
+  gint i = 0, j = 0, n = 0;
+
+  while (ok && i < packets) {
+    n = MIN (path->list_size, packets - i);
+
+    ok = bench_push (h, bufs + i, n) == GST_FLOW_OK;
+    for (j = 0; ok && j < n; j++) {
+      GstBuffer *buf = gst_harness_pull (h);
+      gpointer data;
+      gsize size;
+
+      if (!(ok = buf != NULL))
+        break;
+      gst_buffer_extract_dup (buf, 0, -1, &data, &size);
+      out[i + j] = g_bytes_new_take (data, size);
+      gst_buffer_unref (buf);
+    }
+
+    if (path->paced) {
+      GstClockTime before = gst_util_get_timestamp ();
+      g_usleep (VALIDATE_PAUSE_US);
+      paused += gst_util_get_timestamp () - before;
+    }
+
+    if (ok)
+      i += n;
+  }
+  *ns_per_packet = (gdouble) (gst_util_get_timestamp () - start - paused) / packets;
+
+  if (!ok) {
+    g_printerr ("%s: packet %d was not passed through on the %s path\n",
+        pattern->value_nick, i + j, path->name);
+    // the rest were never handed to the harness
+    for (i += n; i < packets; i++)
+      gst_buffer_unref (bufs[i]);
+    for (i = 0; i < packets; i++) {
+      if (out[i])
+        g_bytes_unref (out[i]);
+    }
+    g_clear_pointer (&out, g_free);
+  }
+
+  gst_harness_teardown (h);
+  g_free (bufs);
+  return out;
+}
+
+static void
+bench_fuzz_free (GBytes **out)
+{
+  gint i;
+
+  for (i = 0; out && i < packets; i++)
+    g_bytes_unref (out[i]);
+  g_free (out);
+}
+
+// the index of the first packet that differs, -1 if none does
+static gint
+bench_fuzz_compare (GBytes **expected, GBytes **got)
+{
+  gint i;
+
+  for (i = 0; i < packets; i++) {
+    if (!g_bytes_equal (expected[i], got[i]))
+      return i;
+  }
+
+  return -1;
+}
+
+// random nonces can't be compared, the packets have to decrypt back to the
+// ones that went in instead
+static gint
+bench_fuzz_decrypt (const GEnumValue *pattern, GBytes **encrypted)
+{
+  GstBuffer **plain = bench_fuzz_packets (FALSE, &paths[0]);
+  GstHarness *h = bench_harness ("discorddecrypt", pattern->value, NULL);
+  gint i, bad = -1;
+
+  for (i = 0; i < packets; i++) {
+    GstBuffer *out = NULL;
+    GstMapInfo map;
+
+    if (bad < 0 &&
+        gst_harness_push (h, gst_buffer_new_wrapped_bytes (encrypted[i])) == GST_FLOW_OK)
+      out = gst_harness_try_pull (h);
+
+    gst_buffer_map (plain[i], &map, GST_MAP_READ);
+    if (bad < 0 && (!out || gst_buffer_get_size (out) != map.size ||
+        gst_buffer_memcmp (out, 0, map.data, map.size) != 0))
+      bad = i;
+    gst_buffer_unmap (plain[i], &map);
+
+    if (out)
+      gst_buffer_unref (out);
+    gst_buffer_unref (plain[i]);
+  }
+
+  gst_harness_teardown (h);
+  g_free (plain);
+  return bad;
+}
+
+static void
+bench_print (const gchar *name, const BenchFrame *frame, const BenchResult *r)
+{
+  g_print ("%-36s %3u ms %4u-%-4u %12.0f %10.1f %8.2f\n", name, frame->duration,
+      frame->min_size, frame->max_size, 1e9 / r->ns_per_packet, r->ns_per_packet,
+      r->allocs_per_packet);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *ctx = g_option_context_new ("- benchmark discordcrypto encryption patterns");
+  GError *err = NULL;
+  GstElement *element;
+  GParamSpec *pspec;
+  GEnumClass *patterns;
+  gboolean failed = FALSE;
+  guint f, p;
+
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 2;
+  }
+  g_option_context_free (ctx);
+
+  if (packets <= 0 || list_size <= 0 || startup < 0) {
+    g_printerr ("--packets and --list-size must be positive, --startup can't be negative\n");
+    return 2;
+  }
+
+  if (plugin) {
+    GstPlugin *loaded = gst_plugin_load_file (plugin, &err);
+    if (!loaded) {
+      g_printerr ("could not load %s: %s\n", plugin, err->message);
+      return 2;
+    }
+    gst_object_unref (loaded);
+  }
+
+  element = gst_element_factory_make ("discordcrypto", NULL);
+  if (!element) {
+    g_printerr ("discordcrypto element not found, pass --plugin\n");
+    return 2;
+  }
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (element), "encryption");
+  patterns = g_type_class_ref (pspec->value_type);
+  gst_object_unref (element);
+
+  if (validate) {
+    g_print ("%-36s %-16s %12s %10s %8s\n", "encryption", "path", "packets/s",
+        "ns/packet", "result");
+
+    for (p = 0; p < patterns->n_values; p++) {
+      const GEnumValue *pattern = &patterns->values[p];
+      gboolean suffix = g_str_equal (pattern->value_nick, "xsalsa20_poly1305_suffix");
+      GBytes **reference = NULL;
+      guint i;
+
+      for (i = 0; i < G_N_ELEMENTS (paths); i++) {
+        gdouble ns;
+        GBytes **out = bench_fuzz_run (pattern, &paths[i], &ns);
+        gint bad = -1;
+
+        if (!out) {
+          failed = TRUE;
+          // nothing to compare the others against
+          if (i == 0)
+            break;
+          continue;
+        }
+
+        if (suffix)
+          bad = bench_fuzz_decrypt (pattern, out);
+        else if (reference)
+          bad = bench_fuzz_compare (reference, out);
+
+        if (paths[i].paced)
+          g_print ("%-36s %-16s %12s %10s", pattern->value_nick, paths[i].name, "-", "-");
+        else
+          g_print ("%-36s %-16s %12.0f %10.1f", pattern->value_nick, paths[i].name, 1e9 / ns, ns);
+        if (bad < 0) {
+          g_print (" %8s\n", "ok");
+        } else {
+          g_print (" %8s\n", "differs");
+          g_printerr ("%s: packet %d differs on the %s path with seed %d\n",
+              pattern->value_nick, bad, paths[i].name, seed);
+          failed = TRUE;
+        }
+
+        if (i == 0 && !suffix)
+          reference = out;
+        else
+          bench_fuzz_free (out);
+      }
+
+      bench_fuzz_free (reference);
+    }
+
+    g_type_class_unref (patterns);
+    return failed ? 1 : 0;
+  }
+
+  if (startup > 0) {
+    BenchResult baseline;
+
+    g_print ("%-36s %12s %10s %8s\n", "encryption", "startups/s", "us/startup", "allocs");
+
+    if (!bench_startup ("identity", -1, &baseline))
+      return 1;
+    g_print ("%-36s %12.0f %10.1f %8.1f\n", "identity", 1e9 / baseline.ns_per_packet,
+        baseline.ns_per_packet / 1000, baseline.allocs_per_packet);
+
+    for (p = 0; p < patterns->n_values; p++) {
+      const GEnumValue *pattern = &patterns->values[p];
+      BenchResult r;
+
+      if (!bench_startup ("discordcrypto", pattern->value, &r)) {
+        failed = TRUE;
+        continue;
+      }
+      g_print ("%-36s %12.0f %10.1f %8.1f\n", pattern->value_nick, 1e9 / r.ns_per_packet,
+          r.ns_per_packet / 1000, r.allocs_per_packet);
+    }
+
+    g_type_class_unref (patterns);
+    return failed ? 1 : 0;
+  }
+
+  g_print ("%-36s %6s %9s %12s %10s %8s\n", "encryption", "frame", "bytes",
+      "packets/s", "ns/packet", "allocs");
+
+  for (f = 0; f < G_N_ELEMENTS (frames); f++) {
+    BenchResult baseline;
+
+    if (!bench_run ("identity", -1, &frames[f], &baseline))
+      return 1;
+    bench_print ("identity", &frames[f], &baseline);
+
+    for (p = 0; p < patterns->n_values; p++) {
+      const GEnumValue *pattern = &patterns->values[p];
+      BenchResult r;
+
+      if (!bench_run ("discordcrypto", pattern->value, &frames[f], &r)) {
+        failed = TRUE;
+        continue;
+      }
+      bench_print (pattern->value_nick, &frames[f], &r);
+
+      if (max_ns >= 0 && r.ns_per_packet - baseline.ns_per_packet > max_ns) {
+        g_printerr ("%s: %.1f ns per packet over baseline, limit is %d\n", pattern->value_nick,
+            r.ns_per_packet - baseline.ns_per_packet, max_ns);
+        failed = TRUE;
+      }
+      if (max_allocs >= 0 && r.allocs_per_packet - baseline.allocs_per_packet > max_allocs) {
+        g_printerr ("%s: %.2f allocations per packet over baseline, limit is %.2f\n", pattern->value_nick,
+            r.allocs_per_packet - baseline.allocs_per_packet, max_allocs);
+        failed = TRUE;
+      }
+    }
+  }
+
+  g_type_class_unref (patterns);
+  return failed ? 1 : 0;
+}
@@ -58,12 +58,24 @@
  *   udpsink host=127.0.0.1 port=1234
  * ]|
  * </refsect2>
+ *
+ * With adapt-frame-size the element asks for longer frames when the cpu is
+ * busy, see GST_DISCORDCRYPTO_FRAME_SIZE_HINT.
+ *
+ * Input that is already encrypted, e.g. relayed from another node, is
+ * marked with an encrypted field in its caps naming the encryption mode
+ * (encrypted=(string)xsalsa20_poly1305_lite). The element then passes it
+ * through untouched without mapping a single buffer.
  */
 
+// getloadavg
+#define _DEFAULT_SOURCE
+
 #ifdef HAVE_CONFIG_H
 #  include <config.h>
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <gst/gst.h>
@@ -76,15 +88,53 @@
 #include <sodium.h>
 
 #include "gstdiscordcrypto.h"
+#include "gstdiscordcryptoclip.h"
+#include "gstdiscorddecrypt.h"
+#include "gstdiscordcryptosink.h"
+#include "gstdiscordcryptomux.h"
+#include "gstdiscordcryptofanout.h"
+#include "gstdiscordcryptotracer.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_discord_crypto_debug);
 #define GST_CAT_DEFAULT gst_discord_crypto_debug
 
+#define DEFAULT_MAX_LOAD 0.8
+// 2 us of every 20 ms packet
+#define DEFAULT_MIN_COST_SHARE 0.0001
+
+// tag and nonce memories kept around for packets encrypted without merging
+#define TRAILER_RING_SIZE GST_DISCORDCRYPTO_TRAILER_RING
+
+// counters are only written by the thread encrypting, but read from anywhere
+#define STATS_ADD(filter, field, n) \
+  __atomic_add_fetch (&(filter)->stats.field, (n), __ATOMIC_RELAXED)
+#define STATS_GET(filter, field) \
+  __atomic_load_n (&(filter)->stats.field, __ATOMIC_RELAXED)
+
+enum
+{
+  SIGNAL_REKEY,
+  LAST_SIGNAL
+};
+
 enum
 {
   PROP_0,
   PROP_ENCRYPTION,
-  PROP_KEY
+  PROP_KEY,
+  PROP_WORKERS,
+  PROP_STATS,
+  PROP_MAX_SILENCE_FRAMES,
+  PROP_VECTORIZED,
+  PROP_CLIP_CACHE,
+  PROP_NONCE_START,
+  PROP_NONCE,
+  PROP_NONCE_GROUP,
+  PROP_ADAPT_FRAME_SIZE,
+  PROP_MAX_LOAD,
+  PROP_MIN_COST_SHARE,
+  PROP_KEYSTREAM_RING,
+  PROP_CRYPTO_KERNEL
 };
 
 static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
@@ -109,6 +159,8 @@ static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
         "encoding-name = (string) { \"OPUS\", \"X-GST-OPUS-DRAFT-SPITTKA-00\" }")
     );
 
+static guint gst_discord_crypto_signals[LAST_SIGNAL] = { 0 };
+
 #define gst_discord_crypto_parent_class parent_class
 G_DEFINE_TYPE (GstDiscordcrypto, gst_discord_crypto, GST_TYPE_BASE_TRANSFORM);
 
@@ -117,31 +169,22 @@ static void gst_discord_crypto_set_property (GObject * object, guint prop_id,
 static void gst_discord_crypto_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
 static GstFlowReturn gst_discord_crypto_transform_ip (GstBaseTransform * base, GstBuffer *buf);
-
+static GstFlowReturn gst_discord_crypto_chain (GstPad * pad, GstObject * parent, GstBuffer * buf);
+static GstFlowReturn gst_discord_crypto_chain_list (GstPad * pad, GstObject * parent, GstBufferList * list);
+static gboolean gst_discord_crypto_transform_sink_event (GstBaseTransform * base, GstEvent * event);
+static void gst_discord_crypto_job_run (GstDiscordcryptoJob * job);
+static void gst_discord_crypto_finalize (GObject * object);
+static gboolean gst_discord_crypto_rekey (GstDiscordcrypto * filter, GBytes * key);
+
+static GstFlowReturn gst_discord_crypto_prepare_output_buffer (GstBaseTransform * base,
+    GstBuffer * inbuf, GstBuffer ** outbuf);
+static gboolean gst_discord_crypto_propose_allocation (GstBaseTransform * base,
+    GstQuery * decide_query, GstQuery * query);
+
+static gboolean gst_discord_crypto_set_caps (GstBaseTransform * base, GstCaps * incaps,
+    GstCaps * outcaps);
 static gboolean gst_discord_crypto_start (GstBaseTransform * base);
 static gboolean gst_discord_crypto_stop (GstBaseTransform * base);
-static gboolean gst_discord_crypto_sink_event (GstPad * pad, GstObject * parent, GstEvent * event);
-
-#define GST_TYPE_DISCORDCRYPTO_PATTERN (gst_discord_crypto_pattern_get_type ())
-static GType
-gst_discord_crypto_pattern_get_type (void)
-{
-  static GType discord_crypto_pattern_type = 0;
-
-  if (!discord_crypto_pattern_type) {
-    static GEnumValue pattern_types[] = {
-      { GST_DISCORDCRYPTO_XSALSA20_POLY1305, "xsalsa20_poly1305", "xsalsa20_poly1305" },
-      { GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX, "xsalsa20_poly1305_suffix", "xsalsa20_poly1305_suffix" },
-      { GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE, "xsalsa20_poly1305_lite", "xsalsa20_poly1305_lite" },
-      { 0, NULL, NULL },
-    };
-
-    discord_crypto_pattern_type =
-      g_enum_register_static ("GstDiscordcryptoPattern", pattern_types);
-  }
-
-  return discord_crypto_pattern_type;
-}
 
 static void
 gst_discord_crypto_class_init (GstDiscordcryptoClass * klass)
@@ -154,6 +197,7 @@ gst_discord_crypto_class_init (GstDiscordcryptoClass * klass)
 
   gobject_class->set_property = gst_discord_crypto_set_property;
   gobject_class->get_property = gst_discord_crypto_get_property;
+  gobject_class->finalize = gst_discord_crypto_finalize;
 
   g_object_class_install_property (gobject_class, PROP_ENCRYPTION,
       g_param_spec_enum ("encryption", "Encryption", "type of encryption to use",
@@ -164,6 +208,99 @@ gst_discord_crypto_class_init (GstDiscordcryptoClass * klass)
          g_param_spec_uint("value", "val", "val", 0, 255, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS),
          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_LAX_VALIDATION));
 
+  g_object_class_install_property (gobject_class, PROP_WORKERS,
+      g_param_spec_uint ("workers", "Workers",
+       "size of the process wide crypto thread pool to encrypt on, 0 encrypts on the streaming thread (applied on start)",
+       0, GST_DISCORDCRYPTO_MAX_WORKERS, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_SILENCE_FRAMES,
+      g_param_spec_int ("max-silence-frames", "Max silence frames",
+       "silence and dtx packets sent in a row before the rest are dropped without "
+       "being encrypted, Discord wants 5 after speech, -1 sends all of them",
+       -1, G_MAXINT, -1, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_VECTORIZED,
+      g_param_spec_boolean ("vectorized", "Vectorized",
+       "encrypt buffer lists of the xsalsa20_poly1305 modes " G_STRINGIFY (GST_DISCORDCRYPTO_LANES)
+       " packets at a time, output is the same",
+       FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CLIP_CACHE,
+      g_param_spec_string ("clip-cache", "Clip cache",
+       "directory " GST_DISCORDCRYPTO_CLIP_EVENT " events record clips to and replay them from, "
+       "NULL disables clips", NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_NONCE_START,
+      g_param_spec_uint ("nonce-start", "Nonce start",
+       "counter the lite and rtpsize nonces start from. Set it to the nonce read from a "
+       "previous pipeline to carry on its session. The current key is restarted there too "
+       "unless it is streaming or its nonces are already past it, a nonce is never reused",
+       0, G_MAXUINT32, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_NONCE,
+      g_param_spec_uint ("nonce", "Nonce",
+       "counter the next lite or rtpsize packet is sent with",
+       0, G_MAXUINT32, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_NONCE_GROUP,
+      g_param_spec_string ("nonce-group", "Nonce group",
+       "name of a process wide counter shared by every element streaming with the same key, "
+       "each takes ranges of " G_STRINGIFY (GST_DISCORDCRYPTO_NONCE_RANGE) " nonces from it. "
+       "A new group starts at nonce-start, while streaming a change applies from the next key on",
+       NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPT_FRAME_SIZE,
+      g_param_spec_boolean ("adapt-frame-size", "Adapt frame size",
+       "post a " GST_DISCORDCRYPTO_FRAME_SIZE_HINT " message and send it upstream as "
+       "an event asking for 60 ms frames while the system is loaded and 20 ms once it isn't",
+       FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_LOAD,
+      g_param_spec_double ("max-load", "Max load",
+       "1 minute load average per cpu above which adapt-frame-size asks for 60 ms frames "
+       "if encrypting takes at least min-cost-share, 20 ms are asked for again below half of it",
+       0.0, G_MAXDOUBLE, DEFAULT_MAX_LOAD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_COST_SHARE,
+      g_param_spec_double ("min-cost-share", "Min cost share",
+       "share of a cpu encrypting has to take before adapt-frame-size asks for 60 ms frames, "
+       "so a host kept busy by something else doesn't lengthen every stream, "
+       "20 ms are asked for again below a quarter of it",
+       0.0, 1.0, DEFAULT_MIN_COST_SHARE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEYSTREAM_RING,
+      g_param_spec_uint ("keystream-ring", "Keystream ring",
+       "bytes of locked memory to compute the keystream of upcoming lite and xchacha20 "
+       "rtpsize nonces in on a thread of its own, " G_STRINGIFY (GST_DISCORDCRYPTO_KEYSTREAM_ENTRY)
+       " per packet, 0 disables it (applied on start)",
+       0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CRYPTO_KERNEL,
+      g_param_spec_string ("crypto-kernel", "Crypto kernel",
+       "fastest implementation libsodium picked for this cpu when the plugin was loaded, "
+       "aesni or armcrypto (AES-256-GCM), avx2 or ssse3 (ChaCha20 and Salsa20) or scalar",
+       NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstDiscordcrypto::rekey:
+   * @key: (transfer none): the new 32 byte secret key
+   *
+   * Switches to a new key between two packets without stalling the stream,
+   * e.g. on a voice server handoff. Returns FALSE if the key is too short.
+   */
+  gst_discord_crypto_signals[SIGNAL_REKEY] =
+      g_signal_new ("rekey", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstDiscordcryptoClass, rekey), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 1, G_TYPE_BYTES);
+
+  klass->rekey = gst_discord_crypto_rekey;
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+       "packet, byte, drop and reallocation counters, bucket n of latency-histogram "
+       "counts packets that took less than 2^n us to encrypt",
+       GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
   gst_element_class_set_details_simple(gstelement_class,
     "Discord Voice Encrypter",
@@ -179,6 +316,20 @@ gst_discord_crypto_class_init (GstDiscordcryptoClass * klass)
 
   GST_BASE_TRANSFORM_CLASS (klass)->transform_ip =
       GST_DEBUG_FUNCPTR (gst_discord_crypto_transform_ip);
+  // pre-encrypted input never reaches transform_ip
+  GST_BASE_TRANSFORM_CLASS (klass)->transform_ip_on_passthrough = FALSE;
+
+  GST_BASE_TRANSFORM_CLASS (klass)->set_caps =
+      GST_DEBUG_FUNCPTR (gst_discord_crypto_set_caps);
+
+  GST_BASE_TRANSFORM_CLASS (klass)->prepare_output_buffer =
+      GST_DEBUG_FUNCPTR (gst_discord_crypto_prepare_output_buffer);
+
+  GST_BASE_TRANSFORM_CLASS (klass)->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_discord_crypto_propose_allocation);
+
+  GST_BASE_TRANSFORM_CLASS (klass)->sink_event =
+      GST_DEBUG_FUNCPTR (gst_discord_crypto_transform_sink_event);
 
   GST_BASE_TRANSFORM_CLASS (klass)->start =
       GST_DEBUG_FUNCPTR (gst_discord_crypto_start);
@@ -190,16 +341,57 @@ gst_discord_crypto_class_init (GstDiscordcryptoClass * klass)
 static void
 gst_discord_crypto_init (GstDiscordcrypto * filter)
 {
-  filter->sinkpad = gst_pad_new_from_static_template (&sink_factory, NULL);
-  gst_pad_set_event_function (filter->sinkpad,
-                              GST_DEBUG_FUNCPTR(gst_discord_crypto_sink_event));
+  // match the default of the encryption property
+  filter->encryption = GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE;
+  gst_discord_crypto_keyring_init (&filter->keys);
+
+  // the base class pads are the only ones, events reach sink_event
+  // without another hop
+
+  // lets payloaders pushing buffer lists skip the per-buffer chain
+  gst_pad_set_chain_list_function (GST_BASE_TRANSFORM_SINK_PAD (filter),
+                                   GST_DEBUG_FUNCPTR(gst_discord_crypto_chain_list));
+
+  // buffers only bypass the base class when they're handed to a worker
+  filter->base_chain = GST_PAD_CHAINFUNC (GST_BASE_TRANSFORM_SINK_PAD (filter));
+  gst_pad_set_chain_function (GST_BASE_TRANSFORM_SINK_PAD (filter),
+                              GST_DEBUG_FUNCPTR(gst_discord_crypto_chain));
+
+  filter->worker = -1;
+  filter->max_silence_frames = -1;
+  filter->max_load = DEFAULT_MAX_LOAD;
+  filter->min_cost_share = DEFAULT_MIN_COST_SHARE;
+  filter->frame_size = 20;
+  filter->clip_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_mapped_file_unref);
+  g_mutex_init (&filter->jobs_lock);
+  g_cond_init (&filter->jobs_cond);
+  for (int i = 0; i < GST_DISCORDCRYPTO_MAX_JOBS; i++) {
+    filter->jobs[i].job.run = gst_discord_crypto_job_run;
+    filter->jobs[i].filter = filter;
+  }
+}
 
-  GST_PAD_SET_PROXY_CAPS (filter->sinkpad);
-  gst_element_add_pad (GST_ELEMENT (filter), filter->sinkpad);
+static void
+gst_discord_crypto_finalize (GObject * object)
+{
+  GstDiscordcrypto *filter = GST_DISCORDCRYPTO (object);
+
+  g_mutex_clear (&filter->jobs_lock);
+  g_cond_clear (&filter->jobs_cond);
+  gst_discord_crypto_keyring_clear (&filter->keys);
+  g_free (filter->clip_cache);
+  g_free (filter->nonce_group);
+  g_hash_table_unref (filter->clip_files);
+  g_free (filter->recording_id);
+  if (filter->recording)
+    g_byte_array_unref (filter->recording);
+  for (guint i = 0; i < TRAILER_RING_SIZE; i++) {
+    if (filter->trailers[i])
+      gst_memory_unref (filter->trailers[i]);
+  }
 
-  filter->srcpad = gst_pad_new_from_static_template (&src_factory, NULL);
-  GST_PAD_SET_PROXY_CAPS (filter->srcpad);
-  gst_element_add_pad (GST_ELEMENT (filter), filter->srcpad);
+  G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 static void
@@ -210,20 +402,71 @@ gst_discord_crypto_set_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
     case PROP_ENCRYPTION:
-      filter->encryption = g_value_get_enum (value);
+    {
+      GstDiscordcryptoPattern encryption = g_value_get_enum (value);
+      if (encryption == GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE &&
+          !gst_discord_crypto_has_gcm ()) {
+        GST_ELEMENT_WARNING (filter, LIBRARY, INIT,
+          (("AES-256-GCM is not supported by this CPU, using aead_xchacha20_poly1305_rtpsize")), (NULL));
+        encryption = GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE;
+      }
+      g_atomic_int_set ((gint *) &filter->encryption, encryption);
       break;
+    }
     case PROP_KEY:
-      if (gst_value_array_get_size(value) < 32) {
+      if (!gst_discord_crypto_keyring_set_key (&filter->keys, value)) {
         GST_ELEMENT_ERROR (filter, LIBRARY, INIT,
           (("Specifed key too short")), (NULL));
         return;
       }
-      for (int i = 0; i < 32; i++) {
-        const GValue *val = gst_value_array_get_value(value, i);
-        filter->key[i] = g_value_get_uint(val);
-      }
-      // if the key changes this needs to be reset
-      filter->lite_nonce = 0;
+      break;
+    case PROP_WORKERS:
+      filter->workers = g_value_get_uint (value);
+      break;
+    case PROP_MAX_SILENCE_FRAMES:
+      g_atomic_int_set (&filter->max_silence_frames, g_value_get_int (value));
+      break;
+    case PROP_VECTORIZED:
+      g_atomic_int_set (&filter->vectorized, g_value_get_boolean (value));
+      break;
+    case PROP_KEYSTREAM_RING:
+      filter->keystream_ring = g_value_get_uint (value);
+      break;
+    case PROP_ADAPT_FRAME_SIZE:
+      g_atomic_int_set (&filter->adapt_frame_size, g_value_get_boolean (value));
+      break;
+    case PROP_MAX_LOAD:
+      GST_OBJECT_LOCK (filter);
+      filter->max_load = g_value_get_double (value);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_MIN_COST_SHARE:
+      GST_OBJECT_LOCK (filter);
+      filter->min_cost_share = g_value_get_double (value);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_NONCE_START:
+      if (!gst_discord_crypto_keyring_set_nonce_start (&filter->keys, g_value_get_uint (value)))
+        GST_WARNING_OBJECT (filter, "Nonces of the current key are past %u or it is "
+            "streaming, the new start applies from the next key on", g_value_get_uint (value));
+      break;
+    case PROP_NONCE_GROUP: {
+      const gchar *name = g_value_get_string (value);
+      GST_OBJECT_LOCK (filter);
+      g_free (filter->nonce_group);
+      filter->nonce_group = g_strdup (name);
+      GST_OBJECT_UNLOCK (filter);
+      if (!gst_discord_crypto_keyring_set_group (&filter->keys, name))
+        GST_INFO_OBJECT (filter, "Streaming, nonce group %s applies from the next key on",
+            GST_STR_NULL (name));
+      break;
+    }
+    case PROP_CLIP_CACHE:
+      GST_OBJECT_LOCK (filter);
+      g_free (filter->clip_cache);
+      filter->clip_cache = g_value_dup_string (value);
+      g_atomic_int_set (&filter->clips, filter->clip_cache != NULL);
+      GST_OBJECT_UNLOCK (filter);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -231,142 +474,1250 @@ gst_discord_crypto_set_property (GObject * object, guint prop_id,
   }
 }
 
+static GstStructure *
+gst_discord_crypto_create_stats (GstDiscordcrypto * filter)
+{
+  GstStructure *stats;
+  GValue latency = G_VALUE_INIT;
+  GValue val = G_VALUE_INIT;
+
+  g_value_init (&latency, GST_TYPE_ARRAY);
+  g_value_init (&val, G_TYPE_UINT64);
+  for (guint i = 0; i < GST_DISCORDCRYPTO_LATENCY_BUCKETS; i++) {
+    g_value_set_uint64 (&val, STATS_GET (filter, latency[i]));
+    gst_value_array_append_value (&latency, &val);
+  }
+  g_value_unset (&val);
+
+  stats = gst_structure_new ("application/x-discordcrypto-stats",
+      "packets", G_TYPE_UINT64, STATS_GET (filter, packets),
+      "bytes-in", G_TYPE_UINT64, STATS_GET (filter, bytes_in),
+      "bytes-out", G_TYPE_UINT64, STATS_GET (filter, bytes_out),
+      "dropped", G_TYPE_UINT64, STATS_GET (filter, dropped),
+      "errors", G_TYPE_UINT64, STATS_GET (filter, errors),
+      "reallocations", G_TYPE_UINT64, STATS_GET (filter, reallocations),
+      "pool-copies", G_TYPE_UINT64, STATS_GET (filter, pool_copies),
+      "nonce-wraps", G_TYPE_UINT64, STATS_GET (filter, nonce_wraps),
+      "silence-dropped", G_TYPE_UINT64, STATS_GET (filter, silence_dropped), NULL);
+
+  gst_structure_take_value (stats, "latency-histogram", &latency);
+
+  return stats;
+}
+
 static void
 gst_discord_crypto_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
 {
   GstDiscordcrypto *filter = GST_DISCORDCRYPTO (object);
 
-  GValue val = G_VALUE_INIT;
-  g_value_init(&val, G_TYPE_UINT);
-
   switch (prop_id) {
     case PROP_ENCRYPTION:
-      g_value_set_enum (value, filter->encryption);
+      g_value_set_enum (value, gst_discord_crypto_mode (filter));
       break;
     case PROP_KEY:
-      for (int i = 0; i < 32; i++) {
-        g_value_set_uint(&val, filter->key[i]);
-        gst_value_array_append_value(value, &val);
-      }
+      gst_discord_crypto_keyring_get_key (&filter->keys, value);
+      break;
+    case PROP_WORKERS:
+      g_value_set_uint (value, filter->workers);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_discord_crypto_create_stats (filter));
+      break;
+    case PROP_MAX_SILENCE_FRAMES:
+      g_value_set_int (value, g_atomic_int_get (&filter->max_silence_frames));
+      break;
+    case PROP_VECTORIZED:
+      g_value_set_boolean (value, g_atomic_int_get (&filter->vectorized));
+      break;
+    case PROP_KEYSTREAM_RING:
+      g_value_set_uint (value, filter->keystream_ring);
+      break;
+    case PROP_CRYPTO_KERNEL:
+      g_value_set_string (value, gst_discord_crypto_kernel ());
+      break;
+    case PROP_ADAPT_FRAME_SIZE:
+      g_value_set_boolean (value, g_atomic_int_get (&filter->adapt_frame_size));
+      break;
+    case PROP_MAX_LOAD:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_double (value, filter->max_load);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_MIN_COST_SHARE:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_double (value, filter->min_cost_share);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_NONCE_START:
+      g_value_set_uint (value, gst_discord_crypto_keyring_get_nonce_start (&filter->keys));
+      break;
+    case PROP_NONCE:
+      g_value_set_uint (value, gst_discord_crypto_keyring_get_nonce (&filter->keys));
+      break;
+    case PROP_NONCE_GROUP:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_string (value, filter->nonce_group);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_CLIP_CACHE:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_string (value, filter->clip_cache);
+      GST_OBJECT_UNLOCK (filter);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
+}
+
+static gboolean
+gst_discord_crypto_rekey (GstDiscordcrypto * filter, GBytes * key)
+{
+  if (!gst_discord_crypto_keyring_set_key_bytes (&filter->keys, key)) {
+    GST_WARNING_OBJECT (filter, "Ignoring rekey, the key is too short");
+    return FALSE;
+  }
+
+  GST_INFO_OBJECT (filter, "Switched to a new key");
+  return TRUE;
+}
+
+static inline void
+gst_discord_crypto_sync_values (GstDiscordcrypto * filter, GstBuffer *buf)
+{
+  GstBaseTransform *base = GST_BASE_TRANSFORM (filter);
+
+  GstClockTime stream_time;
+
+  // nothing is controlled unless a binding was attached, reading the list
+  // head is enough to know and skips the stream time conversion and the
+  // object lock gst_object_sync_values takes
+  if (G_LIKELY (GST_OBJECT (filter)->control_bindings == NULL))
+    return;
 
-  g_value_unset(&val);
+  stream_time = gst_segment_to_stream_time (&base->segment, GST_FORMAT_TIME,
+      GST_BUFFER_TIMESTAMP (buf));
+
+  if (GST_CLOCK_TIME_IS_VALID (stream_time))
+    gst_object_sync_values (GST_OBJECT (filter), stream_time);
 }
 
+// whether the buffer can grow by trailer bytes without gst_buffer_set_size
+// having to copy or failing outright
 static gboolean
-gst_discord_crypto_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+gst_discord_crypto_has_trailer_room (GstBuffer *buf, gsize trailer)
 {
-  GstDiscordcrypto *filter = GST_DISCORDCRYPTO (parent);
+  gsize offset, maxsize;
+  gsize size = gst_buffer_get_sizes (buf, &offset, &maxsize);
+  guint n_mem = gst_buffer_n_memory (buf);
 
-  gboolean ret;
-  switch (GST_EVENT_TYPE (event)) {
-    case GST_EVENT_EOS:
-      ret = gst_pad_push_event (GST_BASE_TRANSFORM (filter)->srcpad, event);
-      break;
+  if (n_mem == 0 || maxsize - offset - size < trailer)
+    return FALSE;
 
-    default:
-      ret = gst_pad_event_default (pad, parent, event);
-      break;
+  return gst_memory_is_writable (gst_buffer_peek_memory (buf, n_mem - 1));
+}
+
+// the encryption mode can change under the streaming thread, it is read
+// once per packet or list and everything sized for the packet derives from
+// that one value
+static inline GstDiscordcryptoPattern
+gst_discord_crypto_mode (GstDiscordcrypto * filter)
+{
+  return g_atomic_int_get ((gint *) &filter->encryption);
+}
+
+// header size of a packet whose clear header is exactly its first memory
+// and whose payload is a single writable memory behind it, as rtpopuspay
+// builds them. Returns 0 for packets that have to be merged to encrypt.
+static gsize
+gst_discord_crypto_scatter_header (GstDiscordcrypto * filter, GstBuffer *buf,
+    GstDiscordcryptoPattern encryption)
+{
+  GstMemory *header;
+  GstMapInfo map;
+  gsize header_size, size;
+
+  if (gst_buffer_n_memory (buf) != 2 ||
+      !gst_memory_is_writable (gst_buffer_peek_memory (buf, 1)))
+    return 0;
+
+  header = gst_buffer_peek_memory (buf, 0);
+  if (!gst_memory_map (header, &map, GST_MAP_READ))
+    return 0;
+  size = map.size;
+  header_size = gst_discord_crypto_header_size (map.data, size,
+      gst_discord_crypto_is_rtpsize (encryption));
+  gst_memory_unmap (header, &map);
+
+  return header_size == size ? header_size : 0;
+}
+
+// whether a packet has to be copied before it can be encrypted in place
+static gboolean
+gst_discord_crypto_needs_copy (GstDiscordcrypto * filter, GstBuffer *buf,
+    GstDiscordcryptoPattern encryption)
+{
+  if (!gst_buffer_is_writable (buf))
+    return TRUE;
+
+  return !gst_discord_crypto_has_trailer_room (buf, gst_discord_crypto_trailer_size (encryption)) &&
+      gst_discord_crypto_scatter_header (filter, buf, encryption) == 0;
+}
+
+// a memory of size bytes from the trailer ring, reused once the packet
+// that carried it was freed
+static GstMemory *
+gst_discord_crypto_trailer_memory (GstDiscordcrypto * filter, gsize size)
+{
+  for (guint i = 0; i < TRAILER_RING_SIZE; i++) {
+    GstMemory **mem = &filter->trailers[filter->next_trailer++ % TRAILER_RING_SIZE];
+
+    if (!*mem)
+      *mem = gst_allocator_alloc (NULL, MAX_TRAILER_SIZE, NULL);
+
+    if (GST_MINI_OBJECT_REFCOUNT_VALUE (*mem) == 1) {
+      gst_memory_resize (*mem, 0, size);
+      return gst_memory_ref (*mem);
+    }
+  }
+
+  // every one of them is still queued downstream
+  return gst_allocator_alloc (NULL, size, NULL);
+}
+
+// copies a packet into a buffer from the element pool, which always has
+// room for the trailer. Returns NULL if the packet doesn't fit.
+static GstBuffer *
+gst_discord_crypto_pooled_copy (GstDiscordcrypto * filter, GstBuffer *inbuf)
+{
+  GstBuffer *outbuf = NULL;
+  GstMapInfo map;
+
+  gsize size = gst_buffer_get_size (inbuf);
+
+  if (!filter->pool || size > MAX_PACKET_SIZE)
+    return NULL;
+
+  if (gst_buffer_pool_acquire_buffer (filter->pool, &outbuf, NULL) != GST_FLOW_OK)
+    return NULL;
+
+  gst_buffer_set_size (outbuf, size);
+  if (!gst_buffer_map (outbuf, &map, GST_MAP_WRITE)) {
+    gst_buffer_unref (outbuf);
+    return NULL;
+  }
+  gst_buffer_extract (inbuf, 0, map.data, size);
+  gst_buffer_unmap (outbuf, &map);
+
+  gst_buffer_copy_into (outbuf, inbuf, GST_BUFFER_COPY_METADATA, 0, -1);
+
+  STATS_ADD (filter, pool_copies, 1);
+
+  return outbuf;
+}
+
+// whether the counter went through 0 within the last n packets
+static inline void
+gst_discord_crypto_check_wrap (GstDiscordcrypto * filter, const GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint n)
+{
+  if (G_UNLIKELY (session->lite_nonce < n) &&
+      (encryption == GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE ||
+       gst_discord_crypto_is_rtpsize (encryption))) {
+    GST_INFO_OBJECT (filter, "Nonce wrapped around");
+    STATS_ADD (filter, nonce_wraps, 1);
+  }
+}
+
+// encrypts a packet found by gst_discord_crypto_scatter_header where its
+// payload is, the header memory is left alone and the tag and nonce are
+// added as memories of their own so nothing gets merged or copied
+static GstFlowReturn
+gst_discord_crypto_encrypt_scattered (GstDiscordcrypto * filter, GstBuffer *buf,
+    GstDiscordcryptoPattern encryption, gsize header_size)
+{
+  gsize trailer_size = gst_discord_crypto_trailer_size (encryption);
+  GstMemory *header = gst_buffer_peek_memory (buf, 0);
+  GstMemory *payload = gst_buffer_peek_memory (buf, 1);
+  GstMemory *mac, *tail = NULL;
+  GstMapInfo header_map, payload_map, mac_map, tail_map;
+  gboolean encrypted = FALSE;
+
+  gboolean tracing = gst_discord_crypto_tracer_enabled ();
+  GstClockTime start = 0, mapped = 0, encrypted_at = 0;
+  if (tracing)
+    start = gst_util_get_timestamp ();
+
+  // the rtpsize modes send the tag and nonce together behind the payload,
+  // the others send the tag in front of it
+  gsize tail_size = trailer_size - crypto_secretbox_MACBYTES;
+  if (gst_discord_crypto_is_rtpsize (encryption)) {
+    mac = gst_discord_crypto_trailer_memory (filter, trailer_size);
+  } else {
+    mac = gst_discord_crypto_trailer_memory (filter, crypto_secretbox_MACBYTES);
+    if (tail_size > 0)
+      tail = gst_discord_crypto_trailer_memory (filter, tail_size);
+  }
+
+  if (!gst_memory_map (header, &header_map, GST_MAP_READ))
+    goto map_failed;
+  if (!gst_memory_map (payload, &payload_map, GST_MAP_READWRITE))
+    goto payload_failed;
+  if (!gst_memory_map (mac, &mac_map, GST_MAP_WRITE))
+    goto mac_failed;
+  if (tail && !gst_memory_map (tail, &tail_map, GST_MAP_WRITE))
+    goto tail_failed;
+
+  if (tracing)
+    mapped = gst_util_get_timestamp ();
+
+  gint slot;
+  GstDiscordcryptoSession *session = gst_discord_crypto_keyring_acquire (&filter->keys, &slot);
+  encrypted = gst_discord_crypto_session_encrypt_detached (session, encryption,
+      header_map.data, header_size, payload_map.data, payload_map.size, mac_map.data,
+      tail ? tail_map.data : mac_map.data + crypto_secretbox_MACBYTES);
+  if (encrypted)
+    gst_discord_crypto_check_wrap (filter, session, encryption, 1);
+  gst_discord_crypto_keyring_release (&filter->keys, slot);
+
+  if (tracing)
+    encrypted_at = gst_util_get_timestamp ();
+
+  if (tail)
+    gst_memory_unmap (tail, &tail_map);
+tail_failed:
+  gst_memory_unmap (mac, &mac_map);
+mac_failed:
+  gst_memory_unmap (payload, &payload_map);
+payload_failed:
+  gst_memory_unmap (header, &header_map);
+map_failed:
+
+  if (!encrypted) {
+    gst_memory_unref (mac);
+    if (tail)
+      gst_memory_unref (tail);
+    GST_ELEMENT_ERROR (filter, STREAM, ENCODE,
+      (("Can't encrypt packet, no AES-256-GCM key set or memory not mappable")), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  if (tail) {
+    gst_buffer_insert_memory (buf, 1, mac);
+    gst_buffer_append_memory (buf, tail);
+  } else if (gst_discord_crypto_is_rtpsize (encryption)) {
+    gst_buffer_append_memory (buf, mac);
+  } else {
+    gst_buffer_insert_memory (buf, 1, mac);
+  }
+
+  if (tracing)
+    gst_discord_crypto_tracer_log (GST_ELEMENT (filter), buf, start, mapped,
+        encrypted_at, gst_util_get_timestamp ());
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_discord_crypto_encrypt_buffer (GstDiscordcrypto * filter, GstBuffer *buf,
+    GstDiscordcryptoPattern encryption)
+{
+  GstMapInfo map;
+
+  // timestamps are only taken for the latency tracer
+  gboolean tracing = gst_discord_crypto_tracer_enabled ();
+  GstClockTime start = 0, mapped = 0, encrypted_at = 0;
+  if (tracing)
+    start = gst_util_get_timestamp ();
+
+  gsize size = gst_buffer_get_size(buf);
+  gsize out_size = size + gst_discord_crypto_trailer_size (encryption);
+
+  // last resort, the map below merges the extra memory into one block
+  if (!gst_discord_crypto_has_trailer_room (buf, out_size - size)) {
+    GST_LOG_OBJECT (filter, "no room for trailer, appending memory");
+    STATS_ADD (filter, reallocations, 1);
+    gst_buffer_append_memory (buf, gst_allocator_alloc (NULL, out_size - size, NULL));
+  } else {
+    gst_buffer_set_size(buf, out_size);
+  }
+  gst_buffer_map(buf, &map, GST_MAP_READWRITE);
+
+  if (!map.data)
+    return GST_FLOW_ERROR;
+
+  if (tracing)
+    mapped = gst_util_get_timestamp ();
+
+  gsize header_size = gst_discord_crypto_header_size (map.data, size,
+      gst_discord_crypto_is_rtpsize (encryption));
+  if (header_size == 0) {
+    gst_buffer_unmap (buf, &map);
+    GST_WARNING_OBJECT (filter, "Dropping invalid RTP packet of %" G_GSIZE_FORMAT " bytes", size);
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  }
+
+  gint slot;
+  GstDiscordcryptoSession *session = gst_discord_crypto_keyring_acquire (&filter->keys, &slot);
+  gboolean encrypted;
+
+  // a group hands out nonces nobody can know in advance
+  const guint8 *stream = NULL;
+  if (filter->keystream && !session->group &&
+      gst_discord_crypto_keystream_supported (encryption) &&
+      gst_discord_crypto_keystream_needed (encryption, size - header_size) <=
+          GST_DISCORDCRYPTO_KEYSTREAM_ENTRY)
+    stream = gst_discord_crypto_keystream_take (filter->keystream, session->key,
+        encryption, session->lite_nonce);
+
+  if (stream) {
+    gst_discord_crypto_session_encrypt_keystream (session, encryption,
+        map.data, header_size, size, stream);
+    gst_discord_crypto_keystream_release (filter->keystream);
+    encrypted = TRUE;
+  } else {
+    encrypted = gst_discord_crypto_session_encrypt (session, encryption,
+        map.data, header_size, size);
+  }
+  if (encrypted)
+    gst_discord_crypto_check_wrap (filter, session, encryption, 1);
+  gst_discord_crypto_keyring_release (&filter->keys, slot);
+
+  if (tracing)
+    encrypted_at = gst_util_get_timestamp ();
+
+  if (!encrypted) {
+    gst_buffer_unmap (buf, &map);
+    GST_ELEMENT_ERROR (filter, STREAM, ENCODE,
+      (("Can't encrypt packet, no AES-256-GCM key set")), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  gst_buffer_unmap (buf, &map);
+
+  if (tracing)
+    gst_discord_crypto_tracer_log (GST_ELEMENT (filter), buf, start, mapped,
+        encrypted_at, gst_util_get_timestamp ());
+
+  return GST_FLOW_OK;
+}
+
+// where the opus payload starts behind the csrcs and the header extension,
+// 0 if the packet is cut short before that
+static gsize
+gst_discord_crypto_payload_offset (GstBuffer *buf, gsize size, const guint8 *header)
+{
+  gsize offset = RTP_HEADER_SIZE + (header[0] & 0x0f) * 4;
+
+  if (header[0] & 0x10) {
+    guint8 ext[4];
+    if (gst_buffer_extract (buf, offset, ext, 4) != 4)
+      return 0;
+    offset += 4 + GST_READ_UINT16_BE (ext + 2) * 4;
+  }
+
+  return offset <= size ? offset : 0;
+}
+
+// whether the opus payload is the 0xF8 0xFF 0xFE silence frame, or a dtx
+// frame of at most 2 bytes that carries no audio
+static gboolean
+gst_discord_crypto_is_silence (GstBuffer *buf, gsize size)
+{
+  guint8 data[RTP_HEADER_SIZE];
+  guint8 payload[3];
+
+  if (gst_buffer_extract (buf, 0, data, RTP_HEADER_SIZE) != RTP_HEADER_SIZE ||
+      (data[0] & 0x20))
+    return FALSE;
+
+  gsize offset = gst_discord_crypto_payload_offset (buf, size, data);
+  if (offset == 0 || size - offset > sizeof payload)
+    return FALSE;
+  if (size - offset < sizeof payload)
+    return TRUE;
+
+  gst_buffer_extract (buf, offset, payload, sizeof payload);
+  return payload[0] == 0xF8 && payload[1] == 0xFF && payload[2] == 0xFE;
+}
+
+// runs on every packet while a clip cache is set: keeps the header the next
+// replay continues from, moves the packet behind the clips replayed so far
+// and stores its payload while a clip is recorded
+static void
+gst_discord_crypto_clip_track (GstDiscordcrypto * filter, GstBuffer *buf, gsize size)
+{
+  guint8 header[RTP_HEADER_SIZE];
+
+  if (filter->replaying ||
+      gst_buffer_extract (buf, 0, header, RTP_HEADER_SIZE) != RTP_HEADER_SIZE ||
+      (header[0] >> 6) != 2)
+    return;
+
+  if (filter->seq_offset || filter->ts_offset) {
+    GST_WRITE_UINT16_BE (header + 2, GST_READ_UINT16_BE (header + 2) + filter->seq_offset);
+    GST_WRITE_UINT32_BE (header + 4, GST_READ_UINT32_BE (header + 4) + filter->ts_offset);
+    gst_buffer_fill (buf, 0, header, RTP_HEADER_SIZE);
+  }
+
+  memcpy (filter->last_header, header, RTP_HEADER_SIZE);
+  filter->have_header = TRUE;
+  filter->last_pts = GST_BUFFER_PTS (buf);
+
+  if (!filter->recording)
+    return;
+
+  gsize offset = gst_discord_crypto_payload_offset (buf, size, header);
+  gsize padding = 0;
+  if (offset && (header[0] & 0x20)) {
+    guint8 last;
+    gst_buffer_extract (buf, size - 1, &last, 1);
+    padding = last;
+  }
+  if (offset == 0 || size - offset < padding || size - offset - padding > G_MAXUINT16)
+    return;
+
+  guint32 ts = GST_READ_UINT32_BE (header + 4);
+  gsize payload_size = size - offset - padding;
+  // the first packet gets its increment once the clip is saved
+  guint16 samples = filter->recorded++ ? ts - filter->recorded_ts : 0;
+  guint8 *payload = gst_discord_crypto_clip_append (filter->recording, samples, payload_size);
+  gst_buffer_extract (buf, offset, payload, payload_size);
+  filter->recorded_ts = ts;
+}
+
+// checked before anything is encrypted, an idle stream costs nearly nothing
+static gboolean
+gst_discord_crypto_drop_silence (GstDiscordcrypto * filter, GstBuffer *buf, gsize size)
+{
+  gint max_silence = g_atomic_int_get (&filter->max_silence_frames);
+
+  if (max_silence < 0 || size < RTP_HEADER_SIZE)
+    return FALSE;
+
+  if (!gst_discord_crypto_is_silence (buf, size)) {
+    filter->silence_frames = 0;
+  } else if (filter->silence_frames >= (guint) max_silence) {
+    STATS_ADD (filter, silence_dropped, 1);
+    return TRUE;
+  } else {
+    filter->silence_frames++;
+  }
+
+  return FALSE;
+}
+
+// keeps a running average of the packet cost and once a second weighs the
+// share of a cpu it adds up to against the load, a change of mind goes out
+// as a hint
+static void
+gst_discord_crypto_adapt_frame_size (GstDiscordcrypto * filter, guint64 took)
+{
+  gdouble loadavg;
+
+  // over roughly the last 16 packets
+  filter->packet_cost += ((gint64) took - (gint64) filter->packet_cost) / 16;
+
+  gint64 now = g_get_monotonic_time ();
+  if (now < filter->next_adapt)
+    return;
+  filter->next_adapt = now + G_USEC_PER_SEC;
+
+  if (getloadavg (&loadavg, 1) < 1)
+    return;
+
+  gdouble load = loadavg / g_get_num_processors ();
+  GST_OBJECT_LOCK (filter);
+  gdouble max_load = filter->max_load;
+  gdouble min_share = filter->min_cost_share;
+  GST_OBJECT_UNLOCK (filter);
+
+  // what encrypting takes of one cpu at the current frame size, longer
+  // frames only help a busy host if this element is part of why it's busy
+  gdouble share = (gdouble) filter->packet_cost / (filter->frame_size * GST_MSECOND);
+
+  // 60 ms frames cut the share to a third, the lower bound leaves room for
+  // that so the hint doesn't flap
+  gint frame_size = filter->frame_size;
+  if (load > max_load && share >= min_share)
+    frame_size = 60;
+  else if (load < max_load / 2 || share < min_share / 4)
+    frame_size = 20;
+
+  if (frame_size == filter->frame_size)
+    return;
+  filter->frame_size = frame_size;
+
+  GST_INFO_OBJECT (filter, "Asking for %d ms frames at load %.2f, %" G_GUINT64_FORMAT
+      " ns per packet (%.3f%% of a cpu)", frame_size, load, filter->packet_cost, share * 100);
+
+  GstStructure *s = gst_structure_new (GST_DISCORDCRYPTO_FRAME_SIZE_HINT,
+      "frame-size", G_TYPE_INT, frame_size,
+      "load", G_TYPE_DOUBLE, load,
+      "packet-cost", G_TYPE_UINT64, filter->packet_cost, NULL);
+  gst_pad_push_event (GST_BASE_TRANSFORM_SINK_PAD (filter),
+      gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM, gst_structure_copy (s)));
+  gst_element_post_message (GST_ELEMENT (filter),
+      gst_message_new_element (GST_OBJECT (filter), s));
+}
+
+static void
+gst_discord_crypto_count (GstDiscordcrypto * filter, GstFlowReturn ret, gsize size_in,
+    gsize size_out, guint64 took)
+{
+  if (ret == GST_FLOW_OK) {
+    // took is in ns, the histogram in us. g_bit_storage (0) is 1, under a
+    // microsecond goes in bucket 0 by hand
+    guint bucket = took < 1000 ? 0 :
+        MIN (g_bit_storage (took / 1000), GST_DISCORDCRYPTO_LATENCY_BUCKETS - 1);
+
+    STATS_ADD (filter, packets, 1);
+    STATS_ADD (filter, bytes_in, size_in);
+    STATS_ADD (filter, bytes_out, size_out);
+    STATS_ADD (filter, latency[bucket], 1);
+
+    if (g_atomic_int_get (&filter->adapt_frame_size))
+      gst_discord_crypto_adapt_frame_size (filter, took);
+  } else if (ret == GST_BASE_TRANSFORM_FLOW_DROPPED) {
+    STATS_ADD (filter, dropped, 1);
+  } else {
+    STATS_ADD (filter, errors, 1);
   }
+}
+
+static GstFlowReturn
+gst_discord_crypto_encrypt (GstDiscordcrypto * filter, GstBuffer *buf,
+    GstDiscordcryptoPattern encryption)
+{
+  GstClockTime start = gst_util_get_timestamp ();
+  gsize size = gst_buffer_get_size (buf);
+
+  if (gst_discord_crypto_drop_silence (filter, buf, size))
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+
+  if (g_atomic_int_get (&filter->clips))
+    gst_discord_crypto_clip_track (filter, buf, size);
+
+  gsize header_size = gst_discord_crypto_scatter_header (filter, buf, encryption);
+  GstFlowReturn ret = header_size ?
+      gst_discord_crypto_encrypt_scattered (filter, buf, encryption, header_size) :
+      gst_discord_crypto_encrypt_buffer (filter, buf, encryption);
+
+  gst_discord_crypto_count (filter, ret, size, gst_buffer_get_size (buf),
+      gst_util_get_timestamp () - start);
+
   return ret;
 }
 
+// packets of a list waiting to be encrypted together by the vectorized kernel
+typedef struct {
+  guint n;
+  // of the list the batch belongs to
+  GstDiscordcryptoPattern encryption;
+  GstClockTime start;
+  GstClockTime traced;
+  GstBuffer *bufs[GST_DISCORDCRYPTO_LANES];
+  GstMapInfo maps[GST_DISCORDCRYPTO_LANES];
+  guint8 *packets[GST_DISCORDCRYPTO_LANES];
+  gsize header_sizes[GST_DISCORDCRYPTO_LANES];
+  gsize sizes[GST_DISCORDCRYPTO_LANES];
+} GstDiscordcryptoLaneBatch;
+
+// whether a packet can go through the kernel, it has to be contiguous with
+// room for the trailer so nothing gets merged when it's mapped
+static gboolean
+gst_discord_crypto_lanes_usable (GstDiscordcrypto * filter, GstBuffer *buf,
+    GstDiscordcryptoPattern encryption)
+{
+  return g_atomic_int_get (&filter->vectorized) &&
+      !gst_discord_crypto_is_rtpsize (encryption) &&
+      gst_buffer_n_memory (buf) == 1 &&
+      gst_discord_crypto_has_trailer_room (buf, gst_discord_crypto_trailer_size (encryption));
+}
+
+static void
+gst_discord_crypto_lanes_flush (GstDiscordcrypto * filter, GstDiscordcryptoLaneBatch * batch)
+{
+  gint slot;
+  guint n = batch->n;
+
+  if (n == 0)
+    return;
+
+  GstClockTime encrypted_at = 0;
+  GstDiscordcryptoSession *session = gst_discord_crypto_keyring_acquire (&filter->keys, &slot);
+  gst_discord_crypto_session_encrypt_lanes (session, batch->encryption, batch->packets,
+      batch->header_sizes, batch->sizes, n);
+  gst_discord_crypto_check_wrap (filter, session, batch->encryption, n);
+  gst_discord_crypto_keyring_release (&filter->keys, slot);
+
+  if (batch->traced)
+    encrypted_at = gst_util_get_timestamp ();
+
+  // every packet of the batch is charged an equal share of it
+  guint64 took = (gst_util_get_timestamp () - batch->start) / n;
+  for (guint i = 0; i < n; i++) {
+    gst_buffer_unmap (batch->bufs[i], &batch->maps[i]);
+    gst_discord_crypto_count (filter, GST_FLOW_OK, batch->sizes[i],
+        gst_buffer_get_size (batch->bufs[i]), took);
+    if (batch->traced)
+      gst_discord_crypto_tracer_log (GST_ELEMENT (filter), batch->bufs[i], batch->traced,
+          batch->traced, encrypted_at, gst_util_get_timestamp ());
+  }
+
+  batch->n = 0;
+}
+
+// maps a packet into the batch, encrypting the batch once it is full.
+// Returns FALSE if the packet is dropped and has to leave the list.
+static gboolean
+gst_discord_crypto_lanes_add (GstDiscordcrypto * filter, GstDiscordcryptoLaneBatch * batch,
+    GstBuffer *buf, GstDiscordcryptoPattern encryption)
+{
+  guint i = batch->n;
+  gsize size = gst_buffer_get_size (buf);
+
+  if (gst_discord_crypto_drop_silence (filter, buf, size))
+    return FALSE;
+
+  if (g_atomic_int_get (&filter->clips))
+    gst_discord_crypto_clip_track (filter, buf, size);
+
+  if (i == 0) {
+    batch->encryption = encryption;
+    batch->start = gst_util_get_timestamp ();
+    batch->traced = gst_discord_crypto_tracer_enabled () ? gst_util_get_timestamp () : 0;
+  }
+
+  gst_buffer_set_size (buf, size + gst_discord_crypto_trailer_size (encryption));
+  if (!gst_buffer_map (buf, &batch->maps[i], GST_MAP_READWRITE)) {
+    gst_discord_crypto_count (filter, GST_BASE_TRANSFORM_FLOW_DROPPED, size, 0, 0);
+    return FALSE;
+  }
+
+  gsize header_size = gst_discord_crypto_header_size (batch->maps[i].data, size, FALSE);
+  if (header_size == 0) {
+    gst_buffer_unmap (buf, &batch->maps[i]);
+    GST_WARNING_OBJECT (filter, "Dropping invalid RTP packet of %" G_GSIZE_FORMAT " bytes", size);
+    gst_discord_crypto_count (filter, GST_BASE_TRANSFORM_FLOW_DROPPED, size, 0, 0);
+    return FALSE;
+  }
+
+  batch->bufs[i] = buf;
+  batch->packets[i] = batch->maps[i].data;
+  batch->header_sizes[i] = header_size;
+  batch->sizes[i] = size;
+
+  if (++batch->n == GST_DISCORDCRYPTO_LANES)
+    gst_discord_crypto_lanes_flush (filter, batch);
+
+  return TRUE;
+}
+
 static GstFlowReturn
 gst_discord_crypto_transform_ip (GstBaseTransform * base, GstBuffer *buf)
 {
   GstDiscordcrypto *filter = GST_DISCORDCRYPTO (base);
 
-  GstClockTime timestamp, stream_time;
-  GstMapInfo map;
+  gst_discord_crypto_sync_values (filter, buf);
 
-  timestamp = GST_BUFFER_TIMESTAMP (buf);
-  stream_time =
-      gst_segment_to_stream_time (&base->segment, GST_FORMAT_TIME, timestamp);
+  return gst_discord_crypto_encrypt (filter, buf, gst_discord_crypto_mode (filter));
+}
 
-  GST_DEBUG_OBJECT (filter, "sync to %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (timestamp));
+// encrypts a writable list in place, invalid packets are removed from it
+static GstFlowReturn
+gst_discord_crypto_encrypt_list (GstDiscordcrypto * filter, GstBufferList * list)
+{
+  GstFlowReturn ret;
+  GstDiscordcryptoLaneBatch batch = { 0, };
+  guint len = gst_buffer_list_length (list);
+  GstDiscordcryptoPattern encryption = gst_discord_crypto_mode (filter);
+
+  for (guint i = 0; i < len;) {
+    GstBuffer *buf = gst_buffer_list_get_writable (list, i);
+
+    if (gst_discord_crypto_needs_copy (filter, buf, encryption)) {
+      GstBuffer *copy = gst_discord_crypto_pooled_copy (filter, buf);
+      if (copy) {
+        gst_buffer_list_remove (list, i, 1);
+        gst_buffer_list_insert (list, i, copy);
+        buf = copy;
+      }
+    }
 
-  if (GST_CLOCK_TIME_IS_VALID (stream_time))
-    gst_object_sync_values (GST_OBJECT (filter), stream_time);
+    if (gst_discord_crypto_lanes_usable (filter, buf, encryption)) {
+      if (gst_discord_crypto_lanes_add (filter, &batch, buf, encryption)) {
+        i++;
+      } else {
+        gst_buffer_list_remove (list, i, 1);
+        len--;
+      }
+      continue;
+    }
 
-  gsize size = gst_buffer_get_size(buf);
-  gsize out_size = size;
+    // keeps the nonces in list order
+    gst_discord_crypto_lanes_flush (filter, &batch);
 
-  switch (filter->encryption) {
-    case GST_DISCORDCRYPTO_XSALSA20_POLY1305: {
-      out_size += crypto_secretbox_MACBYTES;
-      break;
+    ret = gst_discord_crypto_encrypt (filter, buf, encryption);
+    if (ret == GST_BASE_TRANSFORM_FLOW_DROPPED) {
+      gst_buffer_list_remove (list, i, 1);
+      len--;
+      continue;
+    } else if (ret != GST_FLOW_OK) {
+      return ret;
     }
-    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX: {
-      out_size += crypto_secretbox_MACBYTES + crypto_secretbox_NONCEBYTES;
-      break;
+    i++;
+  }
+
+  gst_discord_crypto_lanes_flush (filter, &batch);
+
+  return GST_FLOW_OK;
+}
+
+// blocks the streaming thread until at most limit jobs are queued
+static void
+gst_discord_crypto_wait_jobs (GstDiscordcrypto * filter, gint limit)
+{
+  if (g_atomic_int_get (&filter->in_flight) <= limit)
+    return;
+
+  g_mutex_lock (&filter->jobs_lock);
+  g_atomic_int_set (&filter->waiting, TRUE);
+  while (g_atomic_int_get (&filter->in_flight) > limit)
+    g_cond_wait (&filter->jobs_cond, &filter->jobs_lock);
+  g_atomic_int_set (&filter->waiting, FALSE);
+  g_mutex_unlock (&filter->jobs_lock);
+}
+
+// hands a writable buffer or buffer list to this element's worker
+static GstFlowReturn
+gst_discord_crypto_submit (GstDiscordcrypto * filter, GstMiniObject * packets)
+{
+  GstDiscordcryptoPacketJob *job;
+
+  // errors from the worker surface on the next buffer
+  GstFlowReturn ret = g_atomic_int_get (&filter->worker_flow);
+  if (ret != GST_FLOW_OK) {
+    gst_mini_object_unref (packets);
+    return ret;
+  }
+
+  // a slot is only reused once every job before it ran, jobs run in order
+  gst_discord_crypto_wait_jobs (filter, GST_DISCORDCRYPTO_MAX_JOBS - 1);
+
+  job = &filter->jobs[filter->next_job++ % GST_DISCORDCRYPTO_MAX_JOBS];
+  job->packets = packets;
+
+  gst_object_ref (filter);
+  g_atomic_int_inc (&filter->in_flight);
+  gst_discord_crypto_workers_submit (filter->worker, &job->job);
+
+  return GST_FLOW_OK;
+}
+
+static void
+gst_discord_crypto_job_run (GstDiscordcryptoJob * job)
+{
+  GstDiscordcryptoPacketJob *packet_job = (GstDiscordcryptoPacketJob *) job;
+  GstDiscordcrypto *filter = packet_job->filter;
+  GstPad *srcpad = GST_BASE_TRANSFORM_SRC_PAD (filter);
+  GstFlowReturn ret;
+
+  if (GST_IS_BUFFER_LIST (packet_job->packets)) {
+    GstBufferList *list = GST_BUFFER_LIST_CAST (packet_job->packets);
+
+    ret = gst_discord_crypto_encrypt_list (filter, list);
+    if (ret == GST_FLOW_OK && gst_buffer_list_length (list) > 0)
+      ret = gst_pad_push_list (srcpad, list);
+    else
+      gst_buffer_list_unref (list);
+  } else {
+    GstBuffer *buf = GST_BUFFER_CAST (packet_job->packets);
+
+    ret = gst_discord_crypto_encrypt (filter, buf, gst_discord_crypto_mode (filter));
+    if (ret == GST_FLOW_OK) {
+      ret = gst_pad_push (srcpad, buf);
+    } else {
+      gst_buffer_unref (buf);
+      if (ret == GST_BASE_TRANSFORM_FLOW_DROPPED)
+        ret = GST_FLOW_OK;
     }
-    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE: {
-      out_size += crypto_secretbox_MACBYTES + 4;
-      break;
+  }
+  packet_job->packets = NULL;
+
+  if (ret != GST_FLOW_OK)
+    g_atomic_int_set (&filter->worker_flow, ret);
+
+  g_atomic_int_add (&filter->in_flight, -1);
+  if (g_atomic_int_get (&filter->waiting)) {
+    g_mutex_lock (&filter->jobs_lock);
+    g_cond_broadcast (&filter->jobs_cond);
+    g_mutex_unlock (&filter->jobs_lock);
+  }
+
+  gst_object_unref (filter);
+}
+
+static GstFlowReturn
+gst_discord_crypto_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstBaseTransform *base = GST_BASE_TRANSFORM (parent);
+  GstDiscordcrypto *filter = GST_DISCORDCRYPTO (parent);
+
+  if (filter->worker < 0 || !gst_pad_has_current_caps (base->srcpad) ||
+      gst_base_transform_is_passthrough (base))
+    return filter->base_chain (pad, parent, buf);
+
+  if (gst_discord_crypto_needs_copy (filter, buf, gst_discord_crypto_mode (filter))) {
+    GstBuffer *copy = gst_discord_crypto_pooled_copy (filter, buf);
+    if (copy) {
+      gst_buffer_unref (buf);
+      buf = copy;
+    } else {
+      buf = gst_buffer_make_writable (buf);
     }
   }
 
-  gst_buffer_set_size(buf, out_size);
-  gst_buffer_map(buf, &map, GST_MAP_READWRITE);
+  gst_discord_crypto_sync_values (filter, buf);
 
-  if (!map.data)
-    return GST_FLOW_ERROR;
+  return gst_discord_crypto_submit (filter, GST_MINI_OBJECT_CAST (buf));
+}
 
-  guint8 nonce[24] = {0};
+static GstFlowReturn
+gst_discord_crypto_chain_list (GstPad * pad, GstObject * parent, GstBufferList * list)
+{
+  GstBaseTransform *base = GST_BASE_TRANSFORM (parent);
+  GstDiscordcrypto *filter = GST_DISCORDCRYPTO (parent);
 
-  guint8 *data = map.data + RTP_HEADER_SIZE;
-  gsize data_size = size - RTP_HEADER_SIZE;
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint len = gst_buffer_list_length (list);
 
-  switch (filter->encryption) {
-    case GST_DISCORDCRYPTO_XSALSA20_POLY1305: {
-      memcpy(nonce, map.data, RTP_HEADER_SIZE);
-      crypto_secretbox_easy(data, data, data_size, nonce, filter->key);
-      break;
+  if (len == 0) {
+    gst_buffer_list_unref (list);
+    return GST_FLOW_OK;
+  }
+
+  // before caps are negotiated let the base class chain each buffer so
+  // it can fail the usual way
+  if (!gst_pad_has_current_caps (base->srcpad)) {
+    for (guint i = 0; i < len && ret == GST_FLOW_OK; i++) {
+      GstBuffer *buf = gst_buffer_ref (gst_buffer_list_get (list, i));
+      ret = filter->base_chain (pad, parent, buf);
     }
-    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX: {
-      randombytes_buf(nonce, sizeof nonce);
-      crypto_secretbox_easy(data, data, data_size, nonce, filter->key);
-      memcpy(map.data + (out_size - 24), nonce, 24);
-      break;
+    gst_buffer_list_unref (list);
+    return ret;
+  }
+
+  // already encrypted upstream, forwarded as is
+  if (gst_base_transform_is_passthrough (base))
+    return gst_pad_push_list (base->srcpad, list);
+
+  list = gst_buffer_list_make_writable (list);
+
+  gst_discord_crypto_sync_values (filter, gst_buffer_list_get (list, 0));
+
+  if (filter->worker >= 0)
+    return gst_discord_crypto_submit (filter, GST_MINI_OBJECT_CAST (list));
+
+  ret = gst_discord_crypto_encrypt_list (filter, list);
+  if (ret != GST_FLOW_OK || gst_buffer_list_length (list) == 0) {
+    gst_buffer_list_unref (list);
+    return ret;
+  }
+
+  return gst_pad_push_list (base->srcpad, list);
+}
+
+static GstFlowReturn
+gst_discord_crypto_prepare_output_buffer (GstBaseTransform * base,
+    GstBuffer * inbuf, GstBuffer ** outbuf)
+{
+  GstDiscordcrypto *filter = GST_DISCORDCRYPTO (base);
+
+  if (!gst_base_transform_is_passthrough (base) &&
+      gst_discord_crypto_needs_copy (filter, inbuf, gst_discord_crypto_mode (filter))) {
+    *outbuf = gst_discord_crypto_pooled_copy (filter, inbuf);
+    if (*outbuf)
+      return GST_FLOW_OK;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->prepare_output_buffer (base, inbuf, outbuf);
+}
+
+static gboolean
+gst_discord_crypto_propose_allocation (GstBaseTransform * base,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstAllocationParams params;
+  GstAllocator *allocator = NULL;
+
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->propose_allocation (base, decide_query, query))
+    return FALSE;
+
+  // ask upstream to leave room after the payload so the trailer can be
+  // written in the same memory
+  if (gst_query_get_n_allocation_params (query) > 0) {
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+    params.padding = MAX (params.padding, MAX_TRAILER_SIZE);
+    gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+    if (allocator)
+      gst_object_unref (allocator);
+  } else {
+    gst_allocation_params_init (&params);
+    params.padding = MAX_TRAILER_SIZE;
+    gst_query_add_allocation_param (query, NULL, &params);
+  }
+
+  return TRUE;
+}
+
+// path of a clip in the cache directory, NULL without one
+static gchar *
+gst_discord_crypto_clip_path (GstDiscordcrypto * filter, const gchar * id)
+{
+  gchar *path = NULL;
+
+  GST_OBJECT_LOCK (filter);
+  if (filter->clip_cache) {
+    gchar *name = g_strconcat (id, GST_DISCORDCRYPTO_CLIP_SUFFIX, NULL);
+    path = g_build_filename (filter->clip_cache, name, NULL);
+    g_free (name);
+  }
+  GST_OBJECT_UNLOCK (filter);
+
+  return path;
+}
+
+static void
+gst_discord_crypto_clip_record (GstDiscordcrypto * filter, const gchar * id)
+{
+  g_free (filter->recording_id);
+  if (filter->recording)
+    g_byte_array_unref (filter->recording);
+
+  GST_INFO_OBJECT (filter, "Recording clip %s", id);
+  filter->recording_id = g_strdup (id);
+  filter->recording = gst_discord_crypto_clip_new ();
+  filter->recorded = 0;
+}
+
+static void
+gst_discord_crypto_clip_stop (GstDiscordcrypto * filter)
+{
+  GError *err = NULL;
+
+  if (!filter->recording)
+    return;
+
+  gchar *path = gst_discord_crypto_clip_path (filter, filter->recording_id);
+  if (!path || !gst_discord_crypto_clip_save (filter->recording, path, &err)) {
+    GST_ELEMENT_WARNING (filter, RESOURCE, WRITE,
+        (("Can't save clip %s"), filter->recording_id), ("%s", err ? err->message : "no clip cache"));
+    g_clear_error (&err);
+  } else {
+    GST_INFO_OBJECT (filter, "Saved %u packets of clip %s", filter->recorded, filter->recording_id);
+    // a replay maps the new file
+    g_hash_table_remove (filter->clip_files, filter->recording_id);
+  }
+  g_free (path);
+
+  g_clear_pointer (&filter->recording_id, g_free);
+  g_clear_pointer (&filter->recording, g_byte_array_unref);
+}
+
+/*
+ * Sends the payloads of a cached clip as packets that continue the stream
+ * from the last packet seen, only the header is rewritten and the payload
+ * encrypted. Packets behind it are moved up by the length of the clip.
+ */
+static GstFlowReturn
+gst_discord_crypto_clip_play (GstDiscordcrypto * filter, const gchar * id)
+{
+  GstPad *srcpad = GST_BASE_TRANSFORM_SRC_PAD (filter);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstAllocationParams params;
+  const guint8 *pos = NULL, *payload;
+  guint16 samples;
+  gsize size;
+  guint sent = 0;
+  guint32 clip_samples = 0;
+
+  GMappedFile *file = g_hash_table_lookup (filter->clip_files, id);
+  if (!file) {
+    GError *err = NULL;
+    gchar *path = gst_discord_crypto_clip_path (filter, id);
+
+    file = path ? gst_discord_crypto_clip_open (path, &err) : NULL;
+    g_free (path);
+    if (!file) {
+      GST_ELEMENT_WARNING (filter, RESOURCE, OPEN_READ,
+          (("Can't replay clip %s"), id), ("%s", err ? err->message : "no clip cache"));
+      g_clear_error (&err);
+      return GST_FLOW_OK;
     }
-    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE: {
-      ((guint32 *)&nonce[0])[0] = g_htonl(filter->lite_nonce);
-      if (filter->lite_nonce < 4294967295) {
-        filter->lite_nonce++;
-      } else {
-        filter->lite_nonce = 0;
-      }
-      crypto_secretbox_easy(data, data, data_size, nonce, filter->key);
-      memcpy(map.data + (out_size - 4), &((guint32 *)&nonce[0])[0], 4);
-      break;
+    g_hash_table_insert (filter->clip_files, g_strdup (id), file);
+  }
+
+  if (!filter->have_header || !gst_pad_has_current_caps (srcpad)) {
+    GST_WARNING_OBJECT (filter, "Can't replay clip %s before the first packet", id);
+    return GST_FLOW_OK;
+  }
+
+  gst_allocation_params_init (&params);
+  params.padding = MAX_TRAILER_SIZE;
+
+  filter->replaying = TRUE;
+  while (ret == GST_FLOW_OK &&
+      gst_discord_crypto_clip_next (file, &pos, &samples, &payload, &size)) {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, RTP_HEADER_SIZE + size, &params);
+    guint8 *header = filter->last_header;
+
+    // no csrcs, extension, padding or marker on replayed packets
+    header[0] = 0x80;
+    header[1] &= 0x7f;
+    GST_WRITE_UINT16_BE (header + 2, GST_READ_UINT16_BE (header + 2) + 1);
+    GST_WRITE_UINT32_BE (header + 4, GST_READ_UINT32_BE (header + 4) + samples);
+    gst_buffer_fill (buf, 0, header, RTP_HEADER_SIZE);
+    gst_buffer_fill (buf, RTP_HEADER_SIZE, payload, size);
+
+    // the opus rtp clock always runs at 48 kHz
+    if (GST_CLOCK_TIME_IS_VALID (filter->last_pts))
+      filter->last_pts += gst_util_uint64_scale_int (samples, GST_SECOND, 48000);
+    GST_BUFFER_PTS (buf) = filter->last_pts;
+
+    sent++;
+    clip_samples += samples;
+
+    ret = gst_discord_crypto_encrypt (filter, buf, gst_discord_crypto_mode (filter));
+    if (ret == GST_FLOW_OK) {
+      ret = gst_pad_push (srcpad, buf);
+    } else {
+      gst_buffer_unref (buf);
+      if (ret == GST_BASE_TRANSFORM_FLOW_DROPPED)
+        ret = GST_FLOW_OK;
     }
   }
+  filter->replaying = FALSE;
 
-  gst_buffer_unmap (buf, &map);
+  filter->seq_offset += sent;
+  filter->ts_offset += clip_samples;
+  GST_DEBUG_OBJECT (filter, "Replayed %u packets of clip %s", sent, id);
 
-  return GST_FLOW_OK;
+  return ret;
+}
+
+// GST_DISCORDCRYPTO_CLIP_EVENT with a clip-id string and an action string
+// that is record, stop or play
+static gboolean
+gst_discord_crypto_clip_event (GstDiscordcrypto * filter, const GstStructure * s)
+{
+  const gchar *id = gst_structure_get_string (s, "clip-id");
+  const gchar *action = gst_structure_get_string (s, "action");
+
+  if (!action || (!g_str_equal (action, "stop") && !gst_discord_crypto_clip_id_valid (id))) {
+    GST_WARNING_OBJECT (filter, "Ignoring invalid clip event %" GST_PTR_FORMAT, s);
+    return FALSE;
+  }
+
+  if (g_str_equal (action, "record")) {
+    gst_discord_crypto_clip_record (filter, id);
+  } else if (g_str_equal (action, "stop")) {
+    gst_discord_crypto_clip_stop (filter);
+  } else if (g_str_equal (action, "play")) {
+    return gst_discord_crypto_clip_play (filter, id) == GST_FLOW_OK;
+  } else {
+    GST_WARNING_OBJECT (filter, "Unknown clip action %s", action);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_discord_crypto_transform_sink_event (GstBaseTransform * base, GstEvent * event)
+{
+  GstDiscordcrypto *filter = GST_DISCORDCRYPTO (base);
+
+  // serialized events must not overtake packets still queued on the worker
+  if (filter->worker >= 0 && GST_EVENT_IS_SERIALIZED (event)) {
+    gst_discord_crypto_wait_jobs (filter, 0);
+    if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+      g_atomic_int_set (&filter->worker_flow, GST_FLOW_OK);
+  }
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_DOWNSTREAM &&
+      gst_event_has_name (event, GST_DISCORDCRYPTO_CLIP_EVENT) &&
+      g_atomic_int_get (&filter->clips)) {
+    gboolean ret = gst_discord_crypto_clip_event (filter, gst_event_get_structure (event));
+    gst_event_unref (event);
+    return ret;
+  }
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS)
+    gst_discord_crypto_clip_stop (filter);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (base, event);
+}
+
+// caps with an encrypted field carry packets that were encrypted upstream
+static gboolean
+gst_discord_crypto_set_caps (GstBaseTransform * base, GstCaps * incaps, GstCaps * outcaps)
+{
+  GstDiscordcrypto *filter = GST_DISCORDCRYPTO (base);
+  const gchar *encrypted = gst_structure_get_string (gst_caps_get_structure (incaps, 0),
+      "encrypted");
+
+  if (encrypted) {
+    GEnumClass *patterns = g_type_class_ref (GST_TYPE_DISCORDCRYPTO_PATTERN);
+    GEnumValue *pattern = g_enum_get_value_by_nick (patterns, encrypted);
+
+    if (!pattern || pattern->value != (gint) gst_discord_crypto_mode (filter))
+      GST_WARNING_OBJECT (filter, "Input is encrypted with %s, not the configured mode", encrypted);
+    g_type_class_unref (patterns);
+
+    GST_INFO_OBJECT (filter, "Passing through packets encrypted with %s", encrypted);
+  }
+
+  gst_base_transform_set_passthrough (base, encrypted != NULL);
+
+  return TRUE;
 }
 
 static gboolean
 gst_discord_crypto_start (GstBaseTransform * base)
 {
   GstDiscordcrypto *filter = GST_DISCORDCRYPTO (base);
-  GST_INFO_OBJECT (filter, "Starting");
+  GST_INFO_OBJECT (filter, "Starting with the %s kernel", gst_discord_crypto_kernel ());
 
-  GST_INFO_OBJECT (filter, "Initializing libsodium");
+  // nonce-start and nonce-group wait for the next key from here on
+  gst_discord_crypto_keyring_set_streaming (&filter->keys, TRUE);
 
-  if (sodium_init() == -1) {
-    GST_ERROR_OBJECT (filter, "Failed to initialize libsodium");
-    return FALSE;
+  filter->pool = gst_buffer_pool_new ();
+  GstStructure *config = gst_buffer_pool_get_config (filter->pool);
+  gst_buffer_pool_config_set_params (config, NULL, MAX_PACKET_SIZE + MAX_TRAILER_SIZE, 0, 0);
+
+  if (!gst_buffer_pool_set_config (filter->pool, config) ||
+      !gst_buffer_pool_set_active (filter->pool, TRUE)) {
+    GST_WARNING_OBJECT (filter, "Failed to set up buffer pool, packets without room will be copied");
+    gst_object_unref (filter->pool);
+    filter->pool = NULL;
+  }
+
+  if (filter->workers > 0) {
+    gst_discord_crypto_workers_acquire (filter->workers);
+    filter->worker = gst_discord_crypto_workers_assign ();
+    filter->worker_flow = GST_FLOW_OK;
+    GST_INFO_OBJECT (filter, "Encrypting on shared worker %d", filter->worker);
+  }
+
+  if (filter->keystream_ring > 0) {
+    filter->keystream = gst_discord_crypto_keystream_new (filter->keystream_ring);
+    if (!filter->keystream)
+      GST_WARNING_OBJECT (filter, "No keystream ring, %u bytes is less than 2 packets "
+          "or not lockable", filter->keystream_ring);
   }
 
-  GST_INFO_OBJECT (filter, "Successfully initialized libsodium");
   return TRUE;
 }
 
@@ -375,6 +1726,27 @@ gst_discord_crypto_stop (GstBaseTransform * base)
 {
   GstDiscordcrypto *filter = GST_DISCORDCRYPTO (base);
   GST_INFO_OBJECT (filter, "Stopping");
+
+  if (filter->worker >= 0) {
+    gst_discord_crypto_wait_jobs (filter, 0);
+    gst_discord_crypto_workers_release ();
+    filter->worker = -1;
+  }
+
+  if (filter->keystream) {
+    gst_discord_crypto_keystream_free (filter->keystream);
+    filter->keystream = NULL;
+  }
+
+  // nothing encrypts anymore, the counter holds still
+  gst_discord_crypto_keyring_set_streaming (&filter->keys, FALSE);
+
+  if (filter->pool) {
+    gst_buffer_pool_set_active (filter->pool, FALSE);
+    gst_object_unref (filter->pool);
+    filter->pool = NULL;
+  }
+
   GST_LOG_OBJECT (filter, "Stop successfull");
   return TRUE;
 }
@@ -385,8 +1757,25 @@ discordcrypto_init (GstPlugin * discordcrypto)
   GST_DEBUG_CATEGORY_INIT (gst_discord_crypto_debug, "discordcrypto",
       0, "discordcrypto");
 
+  // once for every element, before their classes check for AES-256-GCM
+  if (!gst_discord_crypto_probe ()) {
+    GST_ERROR ("Failed to initialize libsodium");
+    return FALSE;
+  }
+  GST_INFO ("Using the %s kernel", gst_discord_crypto_kernel ());
+
   return gst_element_register (discordcrypto, "discordcrypto", GST_RANK_NONE,
-      GST_TYPE_DISCORDCRYPTO);
+      GST_TYPE_DISCORDCRYPTO) &&
+    gst_element_register (discordcrypto, "discorddecrypt", GST_RANK_NONE,
+      GST_TYPE_DISCORDDECRYPT) &&
+    gst_element_register (discordcrypto, "discordcryptosink", GST_RANK_NONE,
+      GST_TYPE_DISCORDCRYPTOSINK) &&
+    gst_element_register (discordcrypto, "discordcryptomux", GST_RANK_NONE,
+      GST_TYPE_DISCORDCRYPTOMUX) &&
+    gst_element_register (discordcrypto, "discordcryptofanout", GST_RANK_NONE,
+      GST_TYPE_DISCORDCRYPTOFANOUT) &&
+    gst_tracer_register (discordcrypto, "discordcrypto-latency",
+      GST_TYPE_DISCORDCRYPTO_TRACER);
 }
 
 #ifndef PACKAGE
@@ -49,6 +49,10 @@
 #include <gst/gst.h>
 #include <gst/base/gstbasetransform.h>
 
+#include "gstdiscordcryptosession.h"
+#include "gstdiscordcryptoworkers.h"
+#include "gstdiscordcryptokeystream.h"
+
 G_BEGIN_DECLS
 
 /* #defines don't like whitespacey bits */
@@ -66,29 +70,126 @@ G_BEGIN_DECLS
 typedef struct _GstDiscordcrypto      GstDiscordcrypto;
 typedef struct _GstDiscordcryptoClass GstDiscordcryptoClass;
 
-typedef enum {
-  GST_DISCORDCRYPTO_XSALSA20_POLY1305,
-  GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX,
-  GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE
-} GstDiscordcryptoPattern;
+// packets a stream can have queued on its worker before the streaming thread waits
+#define GST_DISCORDCRYPTO_MAX_JOBS 64
+
+// tag and nonce memories a stream can have in flight before allocating more
+#define GST_DISCORDCRYPTO_TRAILER_RING 64
+
+// log2 microsecond buckets, the last one holds everything slower
+#define GST_DISCORDCRYPTO_LATENCY_BUCKETS 16
+
+/*
+ * Element message and upstream custom event sent by adapt-frame-size,
+ * frame-size is the opus frame length in ms to switch to, load the load
+ * average per cpu and packet-cost the average ns spent per packet. The
+ * hint is only sent when packet-cost makes up part of the load.
+ */
+#define GST_DISCORDCRYPTO_FRAME_SIZE_HINT "discordcrypto-frame-size"
+
+typedef struct {
+  guint64 packets;
+  guint64 bytes_in;
+  guint64 bytes_out;
+  // invalid packets, and buffers that failed to encrypt
+  guint64 dropped;
+  guint64 errors;
+  // packets that had memory appended or were copied to get trailer room
+  guint64 reallocations;
+  guint64 pool_copies;
+  guint64 nonce_wraps;
+  // silence past max-silence-frames, not counted as dropped
+  guint64 silence_dropped;
+  guint64 latency[GST_DISCORDCRYPTO_LATENCY_BUCKETS];
+} GstDiscordcryptoStats;
 
-#define RTP_HEADER_SIZE 12
+typedef struct {
+  GstDiscordcryptoJob job;
+  GstDiscordcrypto *filter;
+  // a GstBuffer or a GstBufferList
+  GstMiniObject *packets;
+} GstDiscordcryptoPacketJob;
 
 struct _GstDiscordcrypto
 {
   GstBaseTransform element;
 
-  GstPad *sinkpad, *srcpad;
-
   GstDiscordcryptoPattern encryption;
 
-  guint lite_nonce;
-  guint8 key[32];
+  // keys are swapped without stopping the stream
+  GstDiscordcryptoKeyring keys;
+  // name of the nonce group the keyring takes its nonces from
+  gchar *nonce_group;
+
+  GstDiscordcryptoStats stats;
+
+  // silence and dtx packets sent in a row, only the encrypting thread counts
+  gint max_silence_frames;
+  guint silence_frames;
+
+  // buffer lists go through the vectorized kernel
+  gint vectorized;
+
+  // frame size hints, max_load and min_cost_share are guarded by the object
+  // lock and the rest belongs to the encrypting thread
+  gint adapt_frame_size;
+  gdouble max_load;
+  gdouble min_cost_share;
+  guint64 packet_cost;
+  gint64 next_adapt;
+  gint frame_size;
+
+  // soundboard clips, the directory is guarded by the object lock and
+  // everything else belongs to the streaming thread
+  gchar *clip_cache;
+  gint clips;
+  GHashTable *clip_files;
+  gchar *recording_id;
+  GByteArray *recording;
+  guint recorded;
+  guint32 recorded_ts;
+  gboolean replaying;
+  // header and time of the last packet, replayed clips continue from them
+  guint8 last_header[RTP_HEADER_SIZE];
+  gboolean have_header;
+  GstClockTime last_pts;
+  // added to every packet behind a replayed clip so the stream carries on
+  guint16 seq_offset;
+  guint32 ts_offset;
+
+  // trailers of packets encrypted without merging their memories, only
+  // touched by the thread encrypting
+  GstMemory *trailers[GST_DISCORDCRYPTO_TRAILER_RING];
+  guint next_trailer;
+
+  // fallback for packets upstream didn't leave trailer room in
+  GstBufferPool *pool;
+
+  // keystream computed ahead for the lite counter, NULL unless asked for
+  guint keystream_ring;
+  GstDiscordcryptoKeystream *keystream;
+
+  // shared worker this stream encrypts on, -1 for the streaming thread
+  guint workers;
+  gint worker;
+  GstPadChainFunction base_chain;
+
+  // ring of jobs, only the streaming thread submits
+  GstDiscordcryptoPacketJob jobs[GST_DISCORDCRYPTO_MAX_JOBS];
+  guint next_job;
+  gint in_flight;
+  gint waiting;
+  gint worker_flow;
+  GMutex jobs_lock;
+  GCond jobs_cond;
 };
 
 struct _GstDiscordcryptoClass 
 {
   GstBaseTransformClass parent_class;
+
+  /* actions */
+  gboolean (*rekey) (GstDiscordcrypto * filter, GBytes * key);
 };
 
 GType gst_discord_crypto_get_type (void);
@@ -0,0 +1,134 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include <sodium.h>
+
+#include "gstdiscordcryptoarena.h"
+
+// free slots of one size, linked through their first bytes
+typedef struct {
+  gsize stride;
+  gpointer free_slots;
+} GstDiscordcryptoArenaClass;
+
+static GMutex arena_lock;
+// a handful of sizes at most, one per kind of state
+static GstDiscordcryptoArenaClass arena_classes[4];
+
+static gsize
+gst_discord_crypto_arena_stride (gsize size)
+{
+  return (size + GST_DISCORDCRYPTO_ARENA_ALIGN - 1) & ~(gsize) (GST_DISCORDCRYPTO_ARENA_ALIGN - 1);
+}
+
+static GstDiscordcryptoArenaClass *
+gst_discord_crypto_arena_class (gsize stride)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (arena_classes); i++) {
+    if (arena_classes[i].stride == stride || arena_classes[i].stride == 0) {
+      arena_classes[i].stride = stride;
+      return &arena_classes[i];
+    }
+  }
+
+  g_error ("discordcrypto arena out of size classes");
+  return NULL;
+}
+
+gpointer
+gst_discord_crypto_arena_alloc (gsize size)
+{
+  gsize stride = gst_discord_crypto_arena_stride (MAX (size, sizeof (gpointer)));
+  gpointer slot;
+
+  g_mutex_lock (&arena_lock);
+  GstDiscordcryptoArenaClass *klass = gst_discord_crypto_arena_class (stride);
+
+  if (!klass->free_slots) {
+    // sodium_malloc puts the block right before a guard page, a size that
+    // is a multiple of the alignment keeps its start aligned as well
+    guint8 *chunk = sodium_malloc (stride * GST_DISCORDCRYPTO_ARENA_CHUNK);
+    if (!chunk)
+      g_error ("discordcrypto could not allocate %" G_GSIZE_FORMAT " bytes of locked memory",
+          stride * GST_DISCORDCRYPTO_ARENA_CHUNK);
+
+    for (gint i = GST_DISCORDCRYPTO_ARENA_CHUNK - 1; i >= 0; i--) {
+      *(gpointer *) (chunk + i * stride) = klass->free_slots;
+      klass->free_slots = chunk + i * stride;
+    }
+  }
+
+  slot = klass->free_slots;
+  klass->free_slots = *(gpointer *) slot;
+  g_mutex_unlock (&arena_lock);
+
+  sodium_memzero (slot, stride);
+  return slot;
+}
+
+void
+gst_discord_crypto_arena_free (gpointer slot, gsize size)
+{
+  gsize stride = gst_discord_crypto_arena_stride (MAX (size, sizeof (gpointer)));
+
+  if (!slot)
+    return;
+
+  sodium_memzero (slot, stride);
+
+  g_mutex_lock (&arena_lock);
+  GstDiscordcryptoArenaClass *klass = gst_discord_crypto_arena_class (stride);
+  *(gpointer *) slot = klass->free_slots;
+  klass->free_slots = slot;
+  g_mutex_unlock (&arena_lock);
+}
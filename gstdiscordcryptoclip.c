@@ -0,0 +1,148 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "gstdiscordcryptoclip.h"
+
+#define CLIP_MAGIC "DCC1"
+#define CLIP_MAGIC_SIZE 4
+#define CLIP_ENTRY_SIZE 4
+// 20 ms at the 48 kHz rtp clock of opus
+#define CLIP_DEFAULT_SAMPLES 960
+
+gboolean
+gst_discord_crypto_clip_id_valid (const gchar * id)
+{
+  return id && id[0] != '\0' && id[0] != '.' &&
+      !strchr (id, '/') && !strchr (id, G_DIR_SEPARATOR);
+}
+
+GByteArray *
+gst_discord_crypto_clip_new (void)
+{
+  GByteArray *clip = g_byte_array_sized_new (16 * 1024);
+
+  g_byte_array_append (clip, (const guint8 *) CLIP_MAGIC, CLIP_MAGIC_SIZE);
+
+  return clip;
+}
+
+guint8 *
+gst_discord_crypto_clip_append (GByteArray * clip, guint16 samples, guint16 size)
+{
+  guint offset = clip->len;
+
+  g_byte_array_set_size (clip, offset + CLIP_ENTRY_SIZE + size);
+  GST_WRITE_UINT16_BE (clip->data + offset, samples);
+  GST_WRITE_UINT16_BE (clip->data + offset + 2, size);
+
+  return clip->data + offset + CLIP_ENTRY_SIZE;
+}
+
+gboolean
+gst_discord_crypto_clip_save (GByteArray * clip, const gchar * path, GError ** error)
+{
+  if (clip->len == CLIP_MAGIC_SIZE) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "No packets recorded");
+    return FALSE;
+  }
+
+  // nothing came before the first packet to measure it against, it gets
+  // the increment of the second one
+  guint8 *first = clip->data + CLIP_MAGIC_SIZE;
+  if (GST_READ_UINT16_BE (first) == 0) {
+    gsize second = CLIP_MAGIC_SIZE + CLIP_ENTRY_SIZE + GST_READ_UINT16_BE (first + 2);
+    GST_WRITE_UINT16_BE (first, second + CLIP_ENTRY_SIZE <= clip->len ?
+        GST_READ_UINT16_BE (clip->data + second) : CLIP_DEFAULT_SAMPLES);
+  }
+
+  return g_file_set_contents (path, (const gchar *) clip->data, clip->len, error);
+}
+
+GMappedFile *
+gst_discord_crypto_clip_open (const gchar * path, GError ** error)
+{
+  GMappedFile *file = g_mapped_file_new (path, FALSE, error);
+
+  if (!file)
+    return NULL;
+
+  if (g_mapped_file_get_length (file) < CLIP_MAGIC_SIZE ||
+      memcmp (g_mapped_file_get_contents (file), CLIP_MAGIC, CLIP_MAGIC_SIZE) != 0) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a clip", path);
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  return file;
+}
+
+gboolean
+gst_discord_crypto_clip_next (GMappedFile * file, const guint8 ** pos,
+    guint16 * samples, const guint8 ** payload, gsize * size)
+{
+  const guint8 *data = (const guint8 *) g_mapped_file_get_contents (file);
+  const guint8 *end = data + g_mapped_file_get_length (file);
+  const guint8 *p = *pos ? *pos : data + CLIP_MAGIC_SIZE;
+
+  if (end - p < CLIP_ENTRY_SIZE)
+    return FALSE;
+
+  *samples = GST_READ_UINT16_BE (p);
+  *size = GST_READ_UINT16_BE (p + 2);
+  *payload = p + CLIP_ENTRY_SIZE;
+  if ((gsize) (end - *payload) < *size)
+    return FALSE;
+
+  *pos = *payload + *size;
+  return TRUE;
+}
@@ -0,0 +1,89 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDCRYPTO_CLIP_H__
+#define __GST_DISCORDCRYPTO_CLIP_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Opus payloads of a recorded clip as stored in the clip cache. A 4 byte
+ * magic is followed by one entry per packet: the rtp timestamp increment
+ * and the payload size as big endian 16 bit numbers, then the payload.
+ * Files are named after the clip id with GST_DISCORDCRYPTO_CLIP_SUFFIX.
+ */
+#define GST_DISCORDCRYPTO_CLIP_SUFFIX ".dclip"
+
+// name of the custom downstream event that records and replays clips
+#define GST_DISCORDCRYPTO_CLIP_EVENT "discordcrypto-clip"
+
+// whether id can be used as a file name inside the cache directory
+gboolean gst_discord_crypto_clip_id_valid (const gchar * id);
+
+// an empty clip to append packets to while it is recorded
+GByteArray *gst_discord_crypto_clip_new (void);
+
+// adds a packet of size payload bytes, returns where they have to be written
+guint8 *gst_discord_crypto_clip_append (GByteArray * clip, guint16 samples, guint16 size);
+
+// writes the clip to the file atomically, an empty clip is not saved
+gboolean gst_discord_crypto_clip_save (GByteArray * clip, const gchar * path,
+    GError ** error);
+
+// maps a saved clip, NULL if it is missing or isn't one
+GMappedFile *gst_discord_crypto_clip_open (const gchar * path, GError ** error);
+
+/*
+ * Walks the packets of a mapped clip, *pos starts out as NULL. Returns
+ * FALSE after the last one or at a truncated entry.
+ */
+gboolean gst_discord_crypto_clip_next (GMappedFile * file, const guint8 ** pos,
+    guint16 * samples, const guint8 ** payload, gsize * size);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDCRYPTO_CLIP_H__ */
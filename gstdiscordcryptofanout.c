@@ -0,0 +1,714 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/** * SECTION:element-discordcryptofanout
+ *
+ * Sends one opus stream to any number of Discord voice connections, e.g.
+ * for a bot broadcasting to hundreds of channels, replacing a tee with a
+ * discordcrypto ! udpsink branch per connection. Targets are added and
+ * removed at any time with the add-target and remove-target action signals,
+ * each with its own key, encryption mode, ssrc and voice server.
+ *
+ * Every packet is copied into a preallocated slot per target, the ssrc is
+ * rewritten and the copy encrypted in place. Built with HAVE_LIBURING the
+ * slots are submitted to an io_uring and sent asynchronously, otherwise, or
+ * if the kernel refuses the ring, every packet goes out with one sendmmsg
+ * per socket.
+ *
+ * <refsect2>
+ * <title>Adding a target from an application</title>
+ * |[
+ * guint id;
+ * g_signal_emit_by_name (fanout, "add-target", key, GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE,
+ *     ssrc, "127.0.0.1", 1234, &id);
+ * ]|
+ * </refsect2>
+ */
+
+// sendmmsg
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include <sodium.h>
+
+#include "gstdiscordcryptofanout.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_discord_crypto_fanout_debug);
+#define GST_CAT_DEFAULT gst_discord_crypto_fanout_debug
+
+enum
+{
+  PROP_0,
+  PROP_N_TARGETS,
+  PROP_DROPPED
+};
+
+enum
+{
+  SIGNAL_ADD_TARGET,
+  SIGNAL_REMOVE_TARGET,
+  LAST_SIGNAL
+};
+
+struct _GstDiscordcryptofanoutSlot
+{
+  GSocket *socket;
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  gsize size;
+  gboolean in_flight;
+  guint8 data[MAX_PACKET_SIZE + MAX_TRAILER_SIZE];
+};
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp, "
+        "media = (string) \"audio\", "
+        "payload = (int) " GST_RTP_PAYLOAD_DYNAMIC_STRING ", "
+        "clock-rate = (int) 48000, "
+        "encoding-params = (string) \"2\", "
+        "encoding-name = (string) { \"OPUS\", \"X-GST-OPUS-DRAFT-SPITTKA-00\" }")
+    );
+
+static guint gst_discord_crypto_fanout_signals[LAST_SIGNAL] = { 0 };
+
+#define gst_discord_crypto_fanout_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstDiscordcryptofanout, gst_discord_crypto_fanout, GST_TYPE_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (gst_discord_crypto_fanout_debug, "discordcryptofanout", 0,
+        "discordcryptofanout"));
+
+static void gst_discord_crypto_fanout_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_discord_crypto_fanout_finalize (GObject * object);
+
+static guint gst_discord_crypto_fanout_add_target (GstDiscordcryptofanout * fanout,
+    GBytes * key, GstDiscordcryptoPattern encryption, guint ssrc, const gchar * host,
+    gint port);
+static gboolean gst_discord_crypto_fanout_remove_target (GstDiscordcryptofanout * fanout,
+    guint id);
+
+static gboolean gst_discord_crypto_fanout_start (GstBaseSink * bsink);
+static gboolean gst_discord_crypto_fanout_stop (GstBaseSink * bsink);
+static GstFlowReturn gst_discord_crypto_fanout_render (GstBaseSink * bsink, GstBuffer * buf);
+static GstFlowReturn gst_discord_crypto_fanout_render_list (GstBaseSink * bsink,
+    GstBufferList * list);
+
+static void
+gst_discord_crypto_fanout_class_init (GstDiscordcryptofanoutClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+  GstBaseSinkClass *gstbasesink_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+  gstbasesink_class = (GstBaseSinkClass *) klass;
+
+  gobject_class->get_property = gst_discord_crypto_fanout_get_property;
+  gobject_class->finalize = gst_discord_crypto_fanout_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_N_TARGETS,
+      g_param_spec_uint ("n-targets", "Number of targets",
+       "voice connections every packet is sent to",
+       0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DROPPED,
+      g_param_spec_uint64 ("dropped", "Dropped",
+       "copies not sent because the io_uring had no room for them",
+       0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstDiscordcryptofanout::add-target:
+   * @key: (transfer none): the 32 byte secret key of the connection
+   * @encryption: the encryption mode of the connection
+   * @ssrc: the ssrc the connection was given by the voice gateway
+   * @host: address of the voice server, resolved before returning
+   * @port: port of the voice server
+   *
+   * Starts sending every packet to another voice connection. Returns the id
+   * of the target for remove-target, or 0 if the key is too short or the
+   * host can't be resolved.
+   */
+  gst_discord_crypto_fanout_signals[SIGNAL_ADD_TARGET] =
+      g_signal_new ("add-target", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstDiscordcryptofanoutClass, add_target), NULL, NULL, NULL,
+      G_TYPE_UINT, 5, G_TYPE_BYTES, GST_TYPE_DISCORDCRYPTO_PATTERN, G_TYPE_UINT,
+      G_TYPE_STRING, G_TYPE_INT);
+
+  /**
+   * GstDiscordcryptofanout::remove-target:
+   * @id: a target returned by add-target
+   *
+   * Stops sending to a voice connection, packets already handed to the
+   * kernel still go out. Returns FALSE if there is no such target.
+   */
+  gst_discord_crypto_fanout_signals[SIGNAL_REMOVE_TARGET] =
+      g_signal_new ("remove-target", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstDiscordcryptofanoutClass, remove_target), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 1, G_TYPE_UINT);
+
+  klass->add_target = gst_discord_crypto_fanout_add_target;
+  klass->remove_target = gst_discord_crypto_fanout_remove_target;
+
+  gst_element_class_set_details_simple(gstelement_class,
+    "Discord Voice Fan-out Sink",
+    "Sink/Network/Encryption/Audio",
+    "Encrypts opus data for many Discord voice connections and sends it over udp",
+    "<<user@hostname.org>>");
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_factory));
+
+  gstbasesink_class->start = GST_DEBUG_FUNCPTR (gst_discord_crypto_fanout_start);
+  gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_discord_crypto_fanout_stop);
+  gstbasesink_class->render = GST_DEBUG_FUNCPTR (gst_discord_crypto_fanout_render);
+  gstbasesink_class->render_list = GST_DEBUG_FUNCPTR (gst_discord_crypto_fanout_render_list);
+}
+
+static void
+gst_discord_crypto_fanout_target_free (gpointer data)
+{
+  GstDiscordcryptofanoutTarget *target = data;
+
+  gst_discord_crypto_keyring_clear (&target->keys);
+  g_free (target);
+}
+
+static void
+gst_discord_crypto_fanout_init (GstDiscordcryptofanout * fanout)
+{
+  g_mutex_init (&fanout->lock);
+  fanout->targets = g_ptr_array_new_with_free_func (gst_discord_crypto_fanout_target_free);
+  fanout->next_id = 1;
+}
+
+static void
+gst_discord_crypto_fanout_finalize (GObject * object)
+{
+  GstDiscordcryptofanout *fanout = GST_DISCORDCRYPTOFANOUT (object);
+
+  g_ptr_array_unref (fanout->targets);
+  g_clear_object (&fanout->sockets[0]);
+  g_clear_object (&fanout->sockets[1]);
+  g_mutex_clear (&fanout->lock);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_discord_crypto_fanout_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstDiscordcryptofanout *fanout = GST_DISCORDCRYPTOFANOUT (object);
+
+  switch (prop_id) {
+    case PROP_N_TARGETS:
+      g_mutex_lock (&fanout->lock);
+      g_value_set_uint (value, fanout->targets->len);
+      g_mutex_unlock (&fanout->lock);
+      break;
+    case PROP_DROPPED:
+      g_mutex_lock (&fanout->lock);
+      g_value_set_uint64 (value, fanout->dropped);
+      g_mutex_unlock (&fanout->lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+// must be called with the lock held, the socket lives as long as the element
+static GSocket *
+gst_discord_crypto_fanout_get_socket (GstDiscordcryptofanout * fanout, GSocketFamily family,
+    GError ** err)
+{
+  gint i = family == G_SOCKET_FAMILY_IPV6;
+
+  if (!fanout->sockets[i])
+    fanout->sockets[i] = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM,
+        G_SOCKET_PROTOCOL_UDP, err);
+
+  return fanout->sockets[i];
+}
+
+static guint
+gst_discord_crypto_fanout_add_target (GstDiscordcryptofanout * fanout, GBytes * key,
+    GstDiscordcryptoPattern encryption, guint ssrc, const gchar * host, gint port)
+{
+  GstDiscordcryptofanoutTarget *target = g_new0 (GstDiscordcryptofanoutTarget, 1);
+  GInetAddress *address;
+  GSocketAddress *sockaddr;
+  GError *err = NULL;
+  guint id;
+
+  gst_discord_crypto_keyring_init (&target->keys);
+  if (!gst_discord_crypto_keyring_set_key_bytes (&target->keys, key)) {
+    GST_WARNING_OBJECT (fanout, "Not adding %s:%d, the key is too short", host, port);
+    gst_discord_crypto_fanout_target_free (target);
+    return 0;
+  }
+
+  if (encryption == GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE &&
+      !gst_discord_crypto_has_gcm ()) {
+    GST_WARNING_OBJECT (fanout, "AES-256-GCM is not supported by this CPU, "
+        "using aead_xchacha20_poly1305_rtpsize for %s:%d", host, port);
+    encryption = GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE;
+  }
+  target->encryption = encryption;
+  target->trailer_size = gst_discord_crypto_trailer_size (encryption);
+  target->ssrc = ssrc;
+
+  // resolved here so the streaming thread never waits on dns
+  address = g_inet_address_new_from_string (host);
+  if (!address) {
+    GResolver *resolver = g_resolver_get_default ();
+    GList *results = g_resolver_lookup_by_name (resolver, host, NULL, &err);
+    g_object_unref (resolver);
+    if (!results) {
+      GST_WARNING_OBJECT (fanout, "Could not resolve %s: %s", host, err->message);
+      g_clear_error (&err);
+      gst_discord_crypto_fanout_target_free (target);
+      return 0;
+    }
+    address = g_object_ref (results->data);
+    g_resolver_free_addresses (results);
+  }
+
+  sockaddr = g_inet_socket_address_new (address, port);
+  target->addr_len = g_socket_address_get_native_size (sockaddr);
+  if (!g_socket_address_to_native (sockaddr, &target->addr, sizeof target->addr, &err)) {
+    GST_WARNING_OBJECT (fanout, "Not adding %s:%d: %s", host, port, err->message);
+    g_clear_error (&err);
+    g_object_unref (sockaddr);
+    g_object_unref (address);
+    gst_discord_crypto_fanout_target_free (target);
+    return 0;
+  }
+  g_object_unref (sockaddr);
+
+  g_mutex_lock (&fanout->lock);
+  target->socket = gst_discord_crypto_fanout_get_socket (fanout,
+      g_inet_address_get_family (address), &err);
+  if (!target->socket) {
+    g_mutex_unlock (&fanout->lock);
+    GST_WARNING_OBJECT (fanout, "Not adding %s:%d: %s", host, port, err->message);
+    g_clear_error (&err);
+    g_object_unref (address);
+    gst_discord_crypto_fanout_target_free (target);
+    return 0;
+  }
+  id = target->id = fanout->next_id++;
+  g_ptr_array_add (fanout->targets, target);
+  g_mutex_unlock (&fanout->lock);
+  g_object_unref (address);
+
+  GST_INFO_OBJECT (fanout, "Sending to %s:%d with ssrc %u as target %u", host, port, ssrc, id);
+  return id;
+}
+
+static gboolean
+gst_discord_crypto_fanout_remove_target (GstDiscordcryptofanout * fanout, guint id)
+{
+  gboolean found = FALSE;
+  guint i;
+
+  g_mutex_lock (&fanout->lock);
+  for (i = 0; i < fanout->targets->len && !found; i++) {
+    GstDiscordcryptofanoutTarget *target = g_ptr_array_index (fanout->targets, i);
+    if (target->id == id) {
+      // order doesn't matter, every target gets every packet
+      g_ptr_array_remove_index_fast (fanout->targets, i);
+      found = TRUE;
+    }
+  }
+  g_mutex_unlock (&fanout->lock);
+
+  if (found)
+    GST_INFO_OBJECT (fanout, "Removed target %u", id);
+  return found;
+}
+
+#ifdef __linux__
+static void
+gst_discord_crypto_fanout_prepare_header (GstDiscordcryptofanout * fanout, guint i)
+{
+  GstDiscordcryptofanoutSlot *slot = &fanout->slots[i];
+
+  fanout->iovecs[i].iov_base = slot->data;
+  fanout->iovecs[i].iov_len = slot->size;
+  memset (&fanout->headers[i], 0, sizeof fanout->headers[i]);
+  fanout->headers[i].msg_hdr.msg_name = &slot->addr;
+  fanout->headers[i].msg_hdr.msg_namelen = slot->addr_len;
+  fanout->headers[i].msg_hdr.msg_iov = &fanout->iovecs[i];
+  fanout->headers[i].msg_hdr.msg_iovlen = 1;
+}
+#endif
+
+// sends the pending slots, runs of slots on the same socket with a single
+// sendmmsg. UDP is best effort, anything but a full buffer loses the packet.
+static void
+gst_discord_crypto_fanout_flush (GstDiscordcryptofanout * fanout)
+{
+  guint n = fanout->n_pending;
+  guint sent = 0;
+
+#ifdef __linux__
+  for (guint i = 0; i < n; i++)
+    gst_discord_crypto_fanout_prepare_header (fanout, i);
+
+  while (sent < n) {
+    GSocket *socket = fanout->slots[sent].socket;
+    guint run = 1;
+    int ret;
+
+    while (sent + run < n && fanout->slots[sent + run].socket == socket)
+      run++;
+
+    ret = sendmmsg (g_socket_get_fd (socket), fanout->headers + sent, run, 0);
+    if (ret >= 0) {
+      sent += ret;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      g_socket_condition_wait (socket, G_IO_OUT, NULL, NULL);
+    } else if (errno != EINTR) {
+      // the message at sent is the one that failed, skip it
+      GST_WARNING_OBJECT (fanout, "Failed to send packet of %" G_GSIZE_FORMAT " bytes: %s",
+          fanout->slots[sent].size, g_strerror (errno));
+      sent++;
+    }
+  }
+#else
+  while (sent < n) {
+    GstDiscordcryptofanoutSlot *slot = &fanout->slots[sent];
+
+    if (sendto (g_socket_get_fd (slot->socket), slot->data, slot->size, 0,
+            (const struct sockaddr *) &slot->addr, slot->addr_len) >= 0) {
+      sent++;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      g_socket_condition_wait (slot->socket, G_IO_OUT, NULL, NULL);
+    } else if (errno != EINTR) {
+      GST_WARNING_OBJECT (fanout, "Failed to send packet of %" G_GSIZE_FORMAT " bytes: %s",
+          slot->size, g_strerror (errno));
+      sent++;
+    }
+  }
+#endif
+
+  fanout->n_pending = 0;
+}
+
+#ifdef HAVE_LIBURING
+// frees the slots of completed sends, waiting for one if wait is set.
+// FALSE if the ring failed and nothing could be reaped.
+static gboolean
+gst_discord_crypto_fanout_reap (GstDiscordcryptofanout * fanout, gboolean wait)
+{
+  struct io_uring_cqe *cqe;
+  gboolean reaped = FALSE;
+
+  while (fanout->in_flight > 0) {
+    int ret = wait ? io_uring_wait_cqe (&fanout->ring, &cqe) :
+        io_uring_peek_cqe (&fanout->ring, &cqe);
+
+    if (ret == -EINTR)
+      continue;
+    if (ret < 0) {
+      if (ret != -EAGAIN)
+        GST_ERROR_OBJECT (fanout, "Failed to wait for io_uring: %s", g_strerror (-ret));
+      break;
+    }
+
+    GstDiscordcryptofanoutSlot *slot = io_uring_cqe_get_data (cqe);
+    // a full socket buffer isn't retried here, the next packet is 20 ms away
+    if (cqe->res < 0)
+      GST_WARNING_OBJECT (fanout, "Failed to send packet of %" G_GSIZE_FORMAT " bytes: %s",
+          slot->size, g_strerror (-cqe->res));
+    slot->in_flight = FALSE;
+    fanout->in_flight--;
+    io_uring_cqe_seen (&fanout->ring, cqe);
+
+    reaped = TRUE;
+    wait = FALSE;
+  }
+
+  return reaped;
+}
+
+// the ring failed with sends the kernel still owns, tearing it down cancels
+// them so the slots can be reused and everything after goes out with sendmmsg
+static void
+gst_discord_crypto_fanout_drop_ring (GstDiscordcryptofanout * fanout)
+{
+  GST_ELEMENT_WARNING (fanout, RESOURCE, WRITE,
+    (("io_uring failed, sending with sendmmsg")), (NULL));
+
+  io_uring_queue_exit (&fanout->ring);
+  fanout->have_ring = FALSE;
+  fanout->in_flight = 0;
+  for (guint i = 0; i < GST_DISCORDCRYPTOFANOUT_SLOTS; i++)
+    fanout->slots[i].in_flight = FALSE;
+}
+#endif
+
+// the next slot to encrypt into, waiting for the kernel to give one back if
+// all of them are in flight
+static GstDiscordcryptofanoutSlot *
+gst_discord_crypto_fanout_next_slot (GstDiscordcryptofanout * fanout)
+{
+#ifdef HAVE_LIBURING
+  if (fanout->have_ring) {
+    GstDiscordcryptofanoutSlot *slot =
+        &fanout->slots[fanout->next_slot % GST_DISCORDCRYPTOFANOUT_SLOTS];
+
+    if (slot->in_flight) {
+      // it may still be queued behind sends that were never submitted
+      io_uring_submit (&fanout->ring);
+      while (slot->in_flight && gst_discord_crypto_fanout_reap (fanout, TRUE))
+        ;
+    }
+    if (!slot->in_flight)
+      return slot;
+    gst_discord_crypto_fanout_drop_ring (fanout);
+  }
+#endif
+
+  if (fanout->n_pending == GST_DISCORDCRYPTOFANOUT_SLOTS)
+    gst_discord_crypto_fanout_flush (fanout);
+
+  return &fanout->slots[fanout->n_pending];
+}
+
+// hands a filled slot over to be sent, with io_uring it goes out on submit
+static void
+gst_discord_crypto_fanout_queue (GstDiscordcryptofanout * fanout,
+    GstDiscordcryptofanoutSlot * slot)
+{
+#ifdef HAVE_LIBURING
+  if (fanout->have_ring) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe (&fanout->ring);
+
+    if (!sqe) {
+      io_uring_submit (&fanout->ring);
+      sqe = io_uring_get_sqe (&fanout->ring);
+    }
+    // the slot was never handed to the kernel and is reused by the next copy
+    if (!sqe) {
+      GST_WARNING_OBJECT (fanout, "No room in the io_uring, dropping packet");
+      slot->in_flight = FALSE;
+      fanout->dropped++;
+      return;
+    }
+
+    guint i = fanout->next_slot++ % GST_DISCORDCRYPTOFANOUT_SLOTS;
+    gst_discord_crypto_fanout_prepare_header (fanout, i);
+    io_uring_prep_sendmsg (sqe, g_socket_get_fd (slot->socket),
+        &fanout->headers[i].msg_hdr, 0);
+    io_uring_sqe_set_data (sqe, slot);
+    slot->in_flight = TRUE;
+    fanout->in_flight++;
+    return;
+  }
+#endif
+
+  fanout->n_pending++;
+}
+
+// sends everything queued since the last call
+static void
+gst_discord_crypto_fanout_submit (GstDiscordcryptofanout * fanout)
+{
+#ifdef HAVE_LIBURING
+  if (fanout->have_ring) {
+    io_uring_submit (&fanout->ring);
+    gst_discord_crypto_fanout_reap (fanout, FALSE);
+    return;
+  }
+#endif
+
+  gst_discord_crypto_fanout_flush (fanout);
+}
+
+static gboolean
+gst_discord_crypto_fanout_start (GstBaseSink * bsink)
+{
+  GstDiscordcryptofanout *fanout = GST_DISCORDCRYPTOFANOUT (bsink);
+
+  fanout->slots = g_new0 (GstDiscordcryptofanoutSlot, GST_DISCORDCRYPTOFANOUT_SLOTS);
+#ifdef __linux__
+  fanout->headers = g_new0 (struct mmsghdr, GST_DISCORDCRYPTOFANOUT_SLOTS);
+  fanout->iovecs = g_new0 (struct iovec, GST_DISCORDCRYPTOFANOUT_SLOTS);
+#endif
+  fanout->n_pending = 0;
+
+#ifdef HAVE_LIBURING
+  int ret = io_uring_queue_init (GST_DISCORDCRYPTOFANOUT_SLOTS, &fanout->ring, 0);
+
+  fanout->have_ring = ret == 0;
+  fanout->next_slot = 0;
+  fanout->in_flight = 0;
+  if (fanout->have_ring)
+    GST_INFO_OBJECT (fanout, "Sending through io_uring");
+  else
+    GST_INFO_OBJECT (fanout, "No io_uring (%s), sending with sendmmsg", g_strerror (-ret));
+#endif
+
+  return TRUE;
+}
+
+static gboolean
+gst_discord_crypto_fanout_stop (GstBaseSink * bsink)
+{
+  GstDiscordcryptofanout *fanout = GST_DISCORDCRYPTOFANOUT (bsink);
+
+#ifdef HAVE_LIBURING
+  // the kernel still points at the slots until every send completed
+  if (fanout->have_ring) {
+    io_uring_submit (&fanout->ring);
+    while (fanout->in_flight > 0 && gst_discord_crypto_fanout_reap (fanout, TRUE))
+      ;
+    io_uring_queue_exit (&fanout->ring);
+    fanout->have_ring = FALSE;
+  }
+#endif
+
+  g_clear_pointer (&fanout->slots, g_free);
+#ifdef __linux__
+  g_clear_pointer (&fanout->headers, g_free);
+  g_clear_pointer (&fanout->iovecs, g_free);
+#endif
+
+  return TRUE;
+}
+
+// must be called with the lock held, queues one encrypted copy per target
+static void
+gst_discord_crypto_fanout_render_packet (GstDiscordcryptofanout * fanout, GstBuffer * buf)
+{
+  gsize size = gst_buffer_get_size (buf);
+  guint i;
+
+  if (size > MAX_PACKET_SIZE) {
+    GST_WARNING_OBJECT (fanout, "Dropping packet of %" G_GSIZE_FORMAT " bytes, too large", size);
+    return;
+  }
+
+  for (i = 0; i < fanout->targets->len; i++) {
+    GstDiscordcryptofanoutTarget *target = g_ptr_array_index (fanout->targets, i);
+    GstDiscordcryptofanoutSlot *slot = gst_discord_crypto_fanout_next_slot (fanout);
+
+    gst_buffer_extract (buf, 0, slot->data, size);
+
+    gsize header_size = gst_discord_crypto_header_size (slot->data, size,
+        gst_discord_crypto_is_rtpsize (target->encryption));
+    if (header_size == 0) {
+      GST_WARNING_OBJECT (fanout, "Dropping invalid RTP packet of %" G_GSIZE_FORMAT
+          " bytes for target %u", size, target->id);
+      continue;
+    }
+
+    // every connection has the ssrc its gateway handed out
+    GST_WRITE_UINT32_BE (slot->data + 8, target->ssrc);
+
+    gint key_slot;
+    GstDiscordcryptoSession *session = gst_discord_crypto_keyring_acquire (&target->keys, &key_slot);
+    gboolean encrypted = gst_discord_crypto_session_encrypt (session, target->encryption,
+        slot->data, header_size, size);
+    gst_discord_crypto_keyring_release (&target->keys, key_slot);
+
+    // one bad connection must not stop the others
+    if (!encrypted) {
+      GST_WARNING_OBJECT (fanout, "Can't encrypt for target %u", target->id);
+      continue;
+    }
+
+    slot->socket = target->socket;
+    memcpy (&slot->addr, &target->addr, target->addr_len);
+    slot->addr_len = target->addr_len;
+    slot->size = size + target->trailer_size;
+    gst_discord_crypto_fanout_queue (fanout, slot);
+  }
+}
+
+static GstFlowReturn
+gst_discord_crypto_fanout_render (GstBaseSink * bsink, GstBuffer * buf)
+{
+  GstDiscordcryptofanout *fanout = GST_DISCORDCRYPTOFANOUT (bsink);
+
+  g_mutex_lock (&fanout->lock);
+  gst_discord_crypto_fanout_render_packet (fanout, buf);
+  gst_discord_crypto_fanout_submit (fanout);
+  g_mutex_unlock (&fanout->lock);
+
+  return GST_FLOW_OK;
+}
+
+// the whole list goes out with one submit
+static GstFlowReturn
+gst_discord_crypto_fanout_render_list (GstBaseSink * bsink, GstBufferList * list)
+{
+  GstDiscordcryptofanout *fanout = GST_DISCORDCRYPTOFANOUT (bsink);
+  guint len = gst_buffer_list_length (list);
+
+  g_mutex_lock (&fanout->lock);
+  for (guint i = 0; i < len; i++)
+    gst_discord_crypto_fanout_render_packet (fanout, gst_buffer_list_get (list, i));
+  gst_discord_crypto_fanout_submit (fanout);
+  g_mutex_unlock (&fanout->lock);
+
+  return GST_FLOW_OK;
+}
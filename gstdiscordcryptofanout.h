@@ -0,0 +1,141 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDCRYPTOFANOUT_H__
+#define __GST_DISCORDCRYPTOFANOUT_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gio/gio.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "gstdiscordcryptosession.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DISCORDCRYPTOFANOUT \
+  (gst_discord_crypto_fanout_get_type())
+#define GST_DISCORDCRYPTOFANOUT(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DISCORDCRYPTOFANOUT,GstDiscordcryptofanout))
+#define GST_DISCORDCRYPTOFANOUT_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_DISCORDCRYPTOFANOUT,GstDiscordcryptofanoutClass))
+#define GST_IS_DISCORDCRYPTOFANOUT(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_DISCORDCRYPTOFANOUT))
+#define GST_IS_DISCORDCRYPTOFANOUT_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_DISCORDCRYPTOFANOUT))
+
+typedef struct _GstDiscordcryptofanout      GstDiscordcryptofanout;
+typedef struct _GstDiscordcryptofanoutClass GstDiscordcryptofanoutClass;
+
+// encrypted copies that can be waiting to be sent, one per target and packet
+#define GST_DISCORDCRYPTOFANOUT_SLOTS 256
+
+// one voice connection the stream is sent to
+typedef struct {
+  guint id;
+  GstDiscordcryptoPattern encryption;
+  gsize trailer_size;
+  GstDiscordcryptoKeyring keys;
+  guint32 ssrc;
+
+  GSocket *socket;
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+} GstDiscordcryptofanoutTarget;
+
+// an encrypted copy, owned by the kernel while it is in flight
+typedef struct _GstDiscordcryptofanoutSlot GstDiscordcryptofanoutSlot;
+
+struct _GstDiscordcryptofanout
+{
+  GstBaseSink element;
+
+  // taken by the streaming thread for a whole packet, and by add-target
+  // and remove-target
+  GMutex lock;
+  GPtrArray *targets;
+  guint next_id;
+  // one per address family, shared by every target of it
+  GSocket *sockets[2];
+
+  // set up on start
+  GstDiscordcryptofanoutSlot *slots;
+#ifdef __linux__
+  struct mmsghdr *headers;
+  struct iovec *iovecs;
+#endif
+  // slots filled since the last flush when sending with sendmmsg
+  guint n_pending;
+  // copies the io_uring had no room for, guarded by the lock
+  guint64 dropped;
+
+#ifdef HAVE_LIBURING
+  // ring the slots are submitted to, sendmmsg is used without one
+  struct io_uring ring;
+  gboolean have_ring;
+  guint next_slot;
+  guint in_flight;
+#endif
+};
+
+struct _GstDiscordcryptofanoutClass
+{
+  GstBaseSinkClass parent_class;
+
+  /* actions */
+  guint (*add_target) (GstDiscordcryptofanout * fanout, GBytes * key,
+      GstDiscordcryptoPattern encryption, guint ssrc, const gchar * host, gint port);
+  gboolean (*remove_target) (GstDiscordcryptofanout * fanout, guint id);
+};
+
+GType gst_discord_crypto_fanout_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDCRYPTOFANOUT_H__ */
@@ -0,0 +1,213 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include <sodium.h>
+
+#include "gstdiscordcryptokeystream.h"
+#include "gstdiscordcryptoarena.h"
+
+// the keystream gst_discord_crypto_session_encrypt_keystream expects for
+// the packet sent with the lite counter
+static void
+gst_discord_crypto_keystream_compute (const guint8 * key, GstDiscordcryptoPattern encryption,
+    guint32 counter, guint8 * out)
+{
+  guint8 nonce[24] = {0};
+
+  GST_WRITE_UINT32_BE (nonce, counter);
+
+  if (encryption == GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE) {
+    crypto_stream_xsalsa20 (out, GST_DISCORDCRYPTO_KEYSTREAM_ENTRY, nonce, key);
+  } else {
+    // xchacha20 is chacha20 with a subkey from the first 16 nonce bytes
+    guint8 subkey[crypto_core_hchacha20_OUTPUTBYTES];
+    guint8 ietf_nonce[crypto_stream_chacha20_ietf_NONCEBYTES] = {0};
+
+    crypto_core_hchacha20 (subkey, nonce, key, NULL);
+    memcpy (ietf_nonce + 4, nonce + 16, 8);
+    crypto_stream_chacha20_ietf (out, GST_DISCORDCRYPTO_KEYSTREAM_ENTRY, ietf_nonce, subkey);
+    sodium_memzero (subkey, sizeof subkey);
+  }
+}
+
+static gboolean
+gst_discord_crypto_keystream_full (GstDiscordcryptoKeystream * ks)
+{
+  return ks->generation == 0 ||
+      ks->tail - (guint) g_atomic_int_get ((gint *) &ks->head) == ks->n_entries;
+}
+
+static gpointer
+gst_discord_crypto_keystream_run (gpointer data)
+{
+  GstDiscordcryptoKeystream *ks = data;
+  guint8 *key = gst_discord_crypto_arena_alloc (crypto_secretbox_KEYBYTES);
+
+  g_mutex_lock (&ks->lock);
+  while (ks->running) {
+    if (gst_discord_crypto_keystream_full (ks)) {
+      g_atomic_int_set (&ks->waiting, TRUE);
+      // a release in between didn't see the flag
+      if (gst_discord_crypto_keystream_full (ks) && ks->running)
+        g_cond_wait (&ks->cond, &ks->lock);
+      g_atomic_int_set (&ks->waiting, FALSE);
+      continue;
+    }
+
+    guint generation = ks->generation;
+    guint32 nonce = ks->next_nonce++;
+    guint slot = ks->tail % ks->n_entries;
+    GstDiscordcryptoPattern encryption = ks->encryption;
+    memcpy (key, ks->key, crypto_secretbox_KEYBYTES);
+    g_mutex_unlock (&ks->lock);
+
+    gst_discord_crypto_keystream_compute (key, encryption, nonce,
+        ks->streams + slot * GST_DISCORDCRYPTO_KEYSTREAM_ENTRY);
+
+    g_mutex_lock (&ks->lock);
+    // dropped if the ring was restarted meanwhile
+    if (generation == ks->generation) {
+      ks->nonces[slot] = nonce;
+      g_atomic_int_set ((gint *) &ks->tail, ks->tail + 1);
+    }
+  }
+  g_mutex_unlock (&ks->lock);
+
+  gst_discord_crypto_arena_free (key, crypto_secretbox_KEYBYTES);
+  return NULL;
+}
+
+GstDiscordcryptoKeystream *
+gst_discord_crypto_keystream_new (gsize bytes)
+{
+  guint n_entries = MIN (bytes / GST_DISCORDCRYPTO_KEYSTREAM_ENTRY, G_MAXINT);
+  GstDiscordcryptoKeystream *ks;
+
+  if (n_entries < 2)
+    return NULL;
+
+  guint8 *streams = sodium_allocarray (n_entries, GST_DISCORDCRYPTO_KEYSTREAM_ENTRY);
+  if (!streams)
+    return NULL;
+
+  ks = g_new0 (GstDiscordcryptoKeystream, 1);
+  g_mutex_init (&ks->lock);
+  g_cond_init (&ks->cond);
+  ks->key = gst_discord_crypto_arena_alloc (crypto_secretbox_KEYBYTES);
+  ks->n_entries = n_entries;
+  ks->streams = streams;
+  ks->nonces = g_new0 (guint32, n_entries);
+  ks->running = TRUE;
+  ks->thread = g_thread_new ("discordcrypto-keystream", gst_discord_crypto_keystream_run, ks);
+
+  return ks;
+}
+
+void
+gst_discord_crypto_keystream_free (GstDiscordcryptoKeystream * ks)
+{
+  g_mutex_lock (&ks->lock);
+  ks->running = FALSE;
+  g_cond_signal (&ks->cond);
+  g_mutex_unlock (&ks->lock);
+  g_thread_join (ks->thread);
+
+  // sodium_free wipes the keystream
+  sodium_free (ks->streams);
+  gst_discord_crypto_arena_free (ks->key, crypto_secretbox_KEYBYTES);
+  g_free (ks->nonces);
+  g_mutex_clear (&ks->lock);
+  g_cond_clear (&ks->cond);
+  g_free (ks);
+}
+
+const guint8 *
+gst_discord_crypto_keystream_take (GstDiscordcryptoKeystream * ks,
+    const guint8 * key, GstDiscordcryptoPattern encryption, guint32 nonce)
+{
+  // key, encryption and head only change on this thread
+  guint slot = ks->head % ks->n_entries;
+
+  if (G_LIKELY (ks->generation != 0 && ks->encryption == encryption &&
+      ks->head != (guint) g_atomic_int_get ((gint *) &ks->tail) &&
+      ks->nonces[slot] == nonce &&
+      sodium_memcmp (ks->key, key, crypto_secretbox_KEYBYTES) == 0))
+    return ks->streams + slot * GST_DISCORDCRYPTO_KEYSTREAM_ENTRY;
+
+  // new key, nonce or mode, or the producer fell behind: start over with
+  // the packet after this one
+  g_mutex_lock (&ks->lock);
+  memcpy (ks->key, key, crypto_secretbox_KEYBYTES);
+  ks->encryption = encryption;
+  ks->next_nonce = nonce + 1;
+  g_atomic_int_set ((gint *) &ks->head, 0);
+  g_atomic_int_set ((gint *) &ks->tail, 0);
+  if (++ks->generation == 0)
+    ks->generation = 1;
+  g_cond_signal (&ks->cond);
+  g_mutex_unlock (&ks->lock);
+
+  return NULL;
+}
+
+void
+gst_discord_crypto_keystream_release (GstDiscordcryptoKeystream * ks)
+{
+  g_atomic_int_set ((gint *) &ks->head, ks->head + 1);
+
+  if (g_atomic_int_get (&ks->waiting)) {
+    g_mutex_lock (&ks->lock);
+    g_cond_signal (&ks->cond);
+    g_mutex_unlock (&ks->lock);
+  }
+}
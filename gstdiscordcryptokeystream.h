@@ -0,0 +1,120 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDCRYPTO_KEYSTREAM_H__
+#define __GST_DISCORDCRYPTO_KEYSTREAM_H__
+
+#include <gst/gst.h>
+
+#include "gstdiscordcryptosession.h"
+
+G_BEGIN_DECLS
+
+// keystream bytes precomputed per nonce, enough for 60 ms at 128 kbit/s
+#define GST_DISCORDCRYPTO_KEYSTREAM_ENTRY 1024
+
+/*
+ * Keystream of the lite counter nonces still to come, computed on a thread
+ * of its own so the streaming thread is left with an xor and Poly1305.
+ * Only the streaming thread takes entries and only the producer thread
+ * adds them, the ring is single producer single consumer. Entries live in
+ * locked memory.
+ */
+typedef struct {
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  gboolean running;
+  gint waiting;
+
+  // what the entries are for, only the consumer changes them, with the
+  // lock held, and bumps generation
+  guint8 *key;
+  GstDiscordcryptoPattern encryption;
+  guint generation;
+  guint32 next_nonce;
+
+  guint n_entries;
+  guint8 *streams;
+  guint32 *nonces;
+  // entries ever taken and added, tail - head are ready
+  guint head;
+  guint tail;
+} GstDiscordcryptoKeystream;
+
+// whether the mode's nonces are a counter whose keystream can be computed ahead
+static inline gboolean
+gst_discord_crypto_keystream_supported (GstDiscordcryptoPattern encryption)
+{
+  return encryption == GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE ||
+      encryption == GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE;
+}
+
+// bytes of keystream a payload of size bytes needs
+static inline gsize
+gst_discord_crypto_keystream_needed (GstDiscordcryptoPattern encryption, gsize size)
+{
+  // xsalsa20 starts the payload right behind the poly1305 key, chacha20
+  // after the whole first block
+  return size + (encryption == GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE ? 32 : 64);
+}
+
+// a ring of at most bytes of keystream, NULL if that's less than 2 entries
+GstDiscordcryptoKeystream *gst_discord_crypto_keystream_new (gsize bytes);
+void gst_discord_crypto_keystream_free (GstDiscordcryptoKeystream * ks);
+
+/*
+ * The keystream for the packet sent with nonce under key, NULL if it isn't
+ * ready. A miss restarts the ring behind nonce. An entry that was returned
+ * has to be given back with gst_discord_crypto_keystream_release before
+ * the next one is taken.
+ */
+const guint8 *gst_discord_crypto_keystream_take (GstDiscordcryptoKeystream * ks,
+    const guint8 * key, GstDiscordcryptoPattern encryption, guint32 nonce);
+void gst_discord_crypto_keystream_release (GstDiscordcryptoKeystream * ks);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDCRYPTO_KEYSTREAM_H__ */
@@ -0,0 +1,184 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include <sodium.h>
+
+#include "gstdiscordcryptolanes.h"
+
+// one 32 bit word of every packet, gcc turns the arithmetic on these into
+// sse2 on x86_64 and neon on arm
+typedef guint32 GstDiscordcryptoVec __attribute__ ((vector_size (4 * GST_DISCORDCRYPTO_LANES)));
+
+#define SPLAT(x) ((GstDiscordcryptoVec) { (x), (x), (x), (x) })
+#define ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTER(a, b, c, d) \
+  x[b] ^= ROTL (x[a] + x[d], 7); \
+  x[c] ^= ROTL (x[b] + x[a], 9); \
+  x[d] ^= ROTL (x[c] + x[b], 13); \
+  x[a] ^= ROTL (x[d] + x[c], 18);
+
+// the 20 rounds of salsa20 without the final addition, which HSalsa20 skips
+static inline void
+gst_discord_crypto_salsa20_rounds (GstDiscordcryptoVec x[16])
+{
+  for (gint i = 0; i < 10; i++) {
+    QUARTER (0, 4, 8, 12);
+    QUARTER (5, 9, 13, 1);
+    QUARTER (10, 14, 2, 6);
+    QUARTER (15, 3, 7, 11);
+    QUARTER (0, 1, 2, 3);
+    QUARTER (5, 6, 7, 4);
+    QUARTER (10, 11, 8, 9);
+    QUARTER (15, 12, 13, 14);
+  }
+}
+
+// the little endian word at offset of every nonce, unused lanes get zeros
+static inline GstDiscordcryptoVec
+gst_discord_crypto_gather (const guint8 * const nonces[], guint n, gsize offset)
+{
+  GstDiscordcryptoVec v = SPLAT (0);
+
+  for (guint i = 0; i < n; i++)
+    v[i] = GST_READ_UINT32_LE (nonces[i] + offset);
+
+  return v;
+}
+
+void
+gst_discord_crypto_secretbox_lanes (guint8 * const data[], const gsize sizes[],
+    const guint8 * const nonces[], guint n, const guint8 * key)
+{
+  GstDiscordcryptoVec x[16], in[16];
+  guint32 stream[GST_DISCORDCRYPTO_LANES][16];
+  guint8 auth_keys[GST_DISCORDCRYPTO_LANES][crypto_onetimeauth_poly1305_KEYBYTES];
+  gsize blocks = 0;
+
+  g_return_if_fail (n <= GST_DISCORDCRYPTO_LANES);
+
+  // HSalsa20 over the first 16 nonce bytes gives every packet its subkey
+  x[0] = SPLAT (0x61707865);
+  x[5] = SPLAT (0x3320646e);
+  x[10] = SPLAT (0x79622d32);
+  x[15] = SPLAT (0x6b206574);
+  for (gint i = 0; i < 4; i++) {
+    x[1 + i] = SPLAT (GST_READ_UINT32_LE (key + 4 * i));
+    x[11 + i] = SPLAT (GST_READ_UINT32_LE (key + 16 + 4 * i));
+    x[6 + i] = gst_discord_crypto_gather (nonces, n, 4 * i);
+  }
+  gst_discord_crypto_salsa20_rounds (x);
+
+  // salsa20 with that subkey and the last 8 nonce bytes
+  in[0] = SPLAT (0x61707865);
+  in[5] = SPLAT (0x3320646e);
+  in[10] = SPLAT (0x79622d32);
+  in[15] = SPLAT (0x6b206574);
+  in[1] = x[0];
+  in[2] = x[5];
+  in[3] = x[10];
+  in[4] = x[15];
+  in[11] = x[6];
+  in[12] = x[7];
+  in[13] = x[8];
+  in[14] = x[9];
+  in[6] = gst_discord_crypto_gather (nonces, n, 16);
+  in[7] = gst_discord_crypto_gather (nonces, n, 20);
+  in[9] = SPLAT (0);
+
+  // the ciphertext goes behind the tag, the first 32 keystream bytes are
+  // the poly1305 key and the message is xored with the ones after
+  for (guint i = 0; i < n; i++) {
+    memmove (data[i] + crypto_secretbox_MACBYTES, data[i], sizes[i]);
+    blocks = MAX (blocks, (sizes[i] + crypto_onetimeauth_poly1305_KEYBYTES + 63) / 64);
+  }
+
+  for (gsize b = 0; b < blocks; b++) {
+    in[8] = SPLAT ((guint32) b);
+    memcpy (x, in, sizeof x);
+    gst_discord_crypto_salsa20_rounds (x);
+    for (gint w = 0; w < 16; w++) {
+      x[w] += in[w];
+      for (guint i = 0; i < n; i++)
+        stream[i][w] = GUINT32_TO_LE (x[w][i]);
+    }
+
+    for (guint i = 0; i < n; i++) {
+      const guint8 *ks = (const guint8 *) stream[i];
+      guint8 *c = data[i] + crypto_secretbox_MACBYTES;
+      gsize skip = 0;
+
+      if (b == 0) {
+        memcpy (auth_keys[i], ks, crypto_onetimeauth_poly1305_KEYBYTES);
+        skip = crypto_onetimeauth_poly1305_KEYBYTES;
+      }
+
+      gsize offset = b * 64 + skip - crypto_onetimeauth_poly1305_KEYBYTES;
+      if (offset >= sizes[i])
+        continue;
+
+      gsize len = MIN (64 - skip, sizes[i] - offset);
+      for (gsize j = 0; j < len; j++)
+        c[offset + j] ^= ks[skip + j];
+    }
+  }
+
+  for (guint i = 0; i < n; i++)
+    crypto_onetimeauth_poly1305 (data[i], data[i] + crypto_secretbox_MACBYTES,
+        sizes[i], auth_keys[i]);
+
+  sodium_memzero (x, sizeof x);
+  sodium_memzero (in, sizeof in);
+  sodium_memzero (stream, sizeof stream);
+  sodium_memzero (auth_keys, sizeof auth_keys);
+}
@@ -0,0 +1,499 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/** * SECTION:element-discordcryptomux
+ *
+ * Encrypts opus data for any number of Discord voice connections in one
+ * element. Every requested sink pad has its own key, encryption mode and
+ * nonce, and all of them are encrypted in a single streaming loop that
+ * pushes one buffer list per round. Connections are told apart downstream
+ * by their ssrc. Inputs are expected to be live, idle pads then don't hold
+ * the others back.
+ *
+ * <refsect2>
+ * <title>Example of two connections sharing one element</title>
+ * |[
+ * gst-launch-1.0 discordcryptomux name=mux ! udpsink host=127.0.0.1 port=1234 \
+ *   audiotestsrc is-live=true ! opusenc frame-size=60 ! rtpopuspay pt=120 ssrc=1 ! mux.sink_0 \
+ *   audiotestsrc is-live=true ! opusenc frame-size=60 ! rtpopuspay pt=120 ssrc=2 ! mux.sink_1
+ * ]|
+ * with the key and encryption properties set on mux.sink_0 and mux.sink_1.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstaggregator.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include <sodium.h>
+
+#include "gstdiscordcryptomux.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_discord_crypto_mux_debug);
+#define GST_CAT_DEFAULT gst_discord_crypto_mux_debug
+
+#define INITIAL_SLOTS 16
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_ENCRYPTION,
+  PROP_PAD_KEY
+};
+
+#define OPUS_RTP_CAPS "application/x-rtp, " \
+        "media = (string) \"audio\", " \
+        "payload = (int) " GST_RTP_PAYLOAD_DYNAMIC_STRING ", " \
+        "clock-rate = (int) 48000, " \
+        "encoding-params = (string) \"2\", " \
+        "encoding-name = (string) { \"OPUS\", \"X-GST-OPUS-DRAFT-SPITTKA-00\" }"
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (OPUS_RTP_CAPS)
+    );
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (OPUS_RTP_CAPS)
+    );
+
+G_DEFINE_TYPE (GstDiscordcryptomuxPad, gst_discord_crypto_mux_pad, GST_TYPE_AGGREGATOR_PAD);
+
+#define gst_discord_crypto_mux_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstDiscordcryptomux, gst_discord_crypto_mux, GST_TYPE_AGGREGATOR,
+    GST_DEBUG_CATEGORY_INIT (gst_discord_crypto_mux_debug, "discordcryptomux", 0,
+        "discordcryptomux"));
+
+static void
+gst_discord_crypto_mux_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDiscordcryptomuxPad *pad = GST_DISCORDCRYPTOMUX_PAD (object);
+
+  switch (prop_id) {
+    case PROP_PAD_ENCRYPTION: {
+      GstDiscordcryptoPattern encryption = g_value_get_enum (value);
+      if (encryption == GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE &&
+          !gst_discord_crypto_has_gcm ()) {
+        GST_WARNING_OBJECT (pad, "AES-256-GCM is not supported by this CPU, "
+            "using aead_xchacha20_poly1305_rtpsize");
+        encryption = GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE;
+      }
+      GST_OBJECT_LOCK (pad);
+      pad->encryption = encryption;
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    }
+    case PROP_PAD_KEY:
+      if (gst_value_array_get_size (value) < 32) {
+        GST_WARNING_OBJECT (pad, "Specifed key too short");
+        return;
+      }
+      GST_OBJECT_LOCK (pad);
+      for (int i = 0; i < 32; i++)
+        pad->key[i] = g_value_get_uint (gst_value_array_get_value (value, i));
+      pad->new_key = TRUE;
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      return;
+  }
+
+  g_atomic_int_set (&pad->changed, TRUE);
+}
+
+static void
+gst_discord_crypto_mux_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstDiscordcryptomuxPad *pad = GST_DISCORDCRYPTOMUX_PAD (object);
+
+  switch (prop_id) {
+    case PROP_PAD_ENCRYPTION:
+      GST_OBJECT_LOCK (pad);
+      g_value_set_enum (value, pad->encryption);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    case PROP_PAD_KEY: {
+      GValue val = G_VALUE_INIT;
+      g_value_init (&val, G_TYPE_UINT);
+      GST_OBJECT_LOCK (pad);
+      for (int i = 0; i < 32; i++) {
+        g_value_set_uint (&val, pad->key[i]);
+        gst_value_array_append_value (value, &val);
+      }
+      GST_OBJECT_UNLOCK (pad);
+      g_value_unset (&val);
+      break;
+    }
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_discord_crypto_mux_pad_finalize (GObject * object)
+{
+  GstDiscordcryptomuxPad *pad = GST_DISCORDCRYPTOMUX_PAD (object);
+
+  sodium_memzero (pad->key, sizeof pad->key);
+
+  G_OBJECT_CLASS (gst_discord_crypto_mux_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_discord_crypto_mux_pad_class_init (GstDiscordcryptomuxPadClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->set_property = gst_discord_crypto_mux_pad_set_property;
+  gobject_class->get_property = gst_discord_crypto_mux_pad_get_property;
+  gobject_class->finalize = gst_discord_crypto_mux_pad_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_ENCRYPTION,
+      g_param_spec_enum ("encryption", "Encryption", "type of encryption to use",
+       GST_TYPE_DISCORDCRYPTO_PATTERN, GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(gobject_class, PROP_PAD_KEY,
+      gst_param_spec_array("key", "Key", "secret key from discord",
+         g_param_spec_uint("value", "val", "val", 0, 255, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS),
+         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_LAX_VALIDATION));
+}
+
+static void
+gst_discord_crypto_mux_pad_init (GstDiscordcryptomuxPad * pad)
+{
+  pad->encryption = GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE;
+  // the slot gets set up on the first round
+  pad->changed = TRUE;
+}
+
+static void gst_discord_crypto_mux_finalize (GObject * object);
+static GstPad *gst_discord_crypto_mux_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_discord_crypto_mux_release_pad (GstElement * element, GstPad * pad);
+static GstFlowReturn gst_discord_crypto_mux_aggregate (GstAggregator * agg, gboolean timeout);
+static GstFlowReturn gst_discord_crypto_mux_update_src_caps (GstAggregator * agg,
+    GstCaps * caps, GstCaps ** ret);
+
+static void
+gst_discord_crypto_mux_class_init (GstDiscordcryptomuxClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+  GstAggregatorClass *gstaggregator_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+  gstaggregator_class = (GstAggregatorClass *) klass;
+
+  gobject_class->finalize = gst_discord_crypto_mux_finalize;
+
+  gst_element_class_set_details_simple(gstelement_class,
+    "Discord Voice Encrypter Mux",
+    "Encryption/Audio",
+    "Encrypts opus data of many Discord voice connections at once",
+    "<<user@hostname.org>>");
+
+  gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
+      &src_factory, GST_TYPE_AGGREGATOR_PAD);
+  gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
+      &sink_factory, GST_TYPE_DISCORDCRYPTOMUX_PAD);
+
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_discord_crypto_mux_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_discord_crypto_mux_release_pad);
+
+  gstaggregator_class->aggregate =
+      GST_DEBUG_FUNCPTR (gst_discord_crypto_mux_aggregate);
+  gstaggregator_class->update_src_caps =
+      GST_DEBUG_FUNCPTR (gst_discord_crypto_mux_update_src_caps);
+}
+
+static void
+gst_discord_crypto_mux_init (GstDiscordcryptomux * mux)
+{
+}
+
+static void
+gst_discord_crypto_mux_finalize (GObject * object)
+{
+  GstDiscordcryptomux *mux = GST_DISCORDCRYPTOMUX (object);
+
+  // sodium_free wipes them
+  if (mux->sessions)
+    sodium_free (mux->sessions);
+  g_free (mux->used);
+  g_free (mux->has_keys);
+  g_free (mux->encryptions);
+  g_free (mux->trailer_sizes);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+// must be called with the object lock held
+static guint
+gst_discord_crypto_mux_add_slot (GstDiscordcryptomux * mux)
+{
+  guint slot;
+
+  for (slot = 0; slot < mux->n_slots; slot++) {
+    if (!mux->used[slot])
+      break;
+  }
+
+  if (slot == mux->n_slots) {
+    guint n_slots = mux->n_slots ? mux->n_slots * 2 : INITIAL_SLOTS;
+
+    // locked memory like the keyrings, copied by hand so the old keys are
+    // wiped when it is freed
+    GstDiscordcryptoSession *sessions = sodium_allocarray (n_slots, sizeof *sessions);
+    if (!sessions)
+      g_error ("discordcryptomux could not allocate %u sessions of locked memory", n_slots);
+    sodium_memzero (sessions, n_slots * sizeof *sessions);
+    if (mux->sessions) {
+      memcpy (sessions, mux->sessions, mux->n_slots * sizeof *sessions);
+      sodium_free (mux->sessions);
+    }
+    mux->sessions = sessions;
+
+    mux->used = g_renew (gboolean, mux->used, n_slots);
+    memset (mux->used + mux->n_slots, 0, (n_slots - mux->n_slots) * sizeof *mux->used);
+    mux->has_keys = g_renew (gboolean, mux->has_keys, n_slots);
+    mux->encryptions = g_renew (GstDiscordcryptoPattern, mux->encryptions, n_slots);
+    mux->trailer_sizes = g_renew (gsize, mux->trailer_sizes, n_slots);
+    mux->n_slots = n_slots;
+  }
+
+  mux->used[slot] = TRUE;
+  mux->has_keys[slot] = FALSE;
+  mux->encryptions[slot] = GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE;
+  mux->trailer_sizes[slot] = gst_discord_crypto_trailer_size (mux->encryptions[slot]);
+
+  return slot;
+}
+
+static GstPad *
+gst_discord_crypto_mux_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstDiscordcryptomux *mux = GST_DISCORDCRYPTOMUX (element);
+  GstPad *pad;
+
+  pad = GST_ELEMENT_CLASS (parent_class)->request_new_pad (element, templ, name, caps);
+  if (!pad)
+    return NULL;
+
+  GST_OBJECT_LOCK (mux);
+  GST_DISCORDCRYPTOMUX_PAD (pad)->slot = gst_discord_crypto_mux_add_slot (mux);
+  GST_OBJECT_UNLOCK (mux);
+
+  GST_DEBUG_OBJECT (mux, "Pad %s uses slot %u", GST_PAD_NAME (pad),
+      GST_DISCORDCRYPTOMUX_PAD (pad)->slot);
+
+  return pad;
+}
+
+static void
+gst_discord_crypto_mux_release_pad (GstElement * element, GstPad * pad)
+{
+  GstDiscordcryptomux *mux = GST_DISCORDCRYPTOMUX (element);
+  guint slot = GST_DISCORDCRYPTOMUX_PAD (pad)->slot;
+
+  GST_OBJECT_LOCK (mux);
+  sodium_memzero (&mux->sessions[slot], sizeof mux->sessions[slot]);
+  mux->used[slot] = FALSE;
+  mux->has_keys[slot] = FALSE;
+  GST_OBJECT_UNLOCK (mux);
+
+  GST_ELEMENT_CLASS (parent_class)->release_pad (element, pad);
+}
+
+// copies what the application staged on the pad into its slot
+static void
+gst_discord_crypto_mux_apply (GstDiscordcryptomux * mux, GstDiscordcryptomuxPad * pad)
+{
+  guint8 key[32];
+  gboolean new_key;
+  guint slot = pad->slot;
+
+  GST_OBJECT_LOCK (pad);
+  mux->encryptions[slot] = pad->encryption;
+  new_key = pad->new_key;
+  memcpy (key, pad->key, sizeof key);
+  pad->new_key = FALSE;
+  GST_OBJECT_UNLOCK (pad);
+
+  mux->trailer_sizes[slot] = gst_discord_crypto_trailer_size (mux->encryptions[slot]);
+  if (new_key) {
+    gst_discord_crypto_session_init (&mux->sessions[slot], key);
+    mux->has_keys[slot] = TRUE;
+  }
+  sodium_memzero (key, sizeof key);
+}
+
+static GstBuffer *
+gst_discord_crypto_mux_encrypt (GstDiscordcryptomux * mux, guint slot, GstBuffer * buf)
+{
+  GstDiscordcryptoPattern encryption = mux->encryptions[slot];
+  gsize trailer = mux->trailer_sizes[slot];
+  gsize offset, maxsize;
+  GstMapInfo map;
+
+  // a new slot is zeroed, it must not send with an all zero key
+  if (G_UNLIKELY (!mux->has_keys[slot])) {
+    GST_DEBUG_OBJECT (mux, "Dropping packet on slot %u, no key set yet", slot);
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+
+  buf = gst_buffer_make_writable (buf);
+
+  gsize size = gst_buffer_get_sizes (buf, &offset, &maxsize);
+  guint n_mem = gst_buffer_n_memory (buf);
+  if (n_mem > 0 && maxsize - offset - size >= trailer &&
+      gst_memory_is_writable (gst_buffer_peek_memory (buf, n_mem - 1)))
+    gst_buffer_set_size (buf, size + trailer);
+  else
+    gst_buffer_append_memory (buf, gst_allocator_alloc (NULL, trailer, NULL));
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READWRITE)) {
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+
+  gsize header_size = gst_discord_crypto_header_size (map.data, size,
+      gst_discord_crypto_is_rtpsize (encryption));
+
+  // one bad connection must not stop the others
+  if (header_size == 0 || !gst_discord_crypto_session_encrypt (&mux->sessions[slot],
+          encryption, map.data, header_size, size)) {
+    gst_buffer_unmap (buf, &map);
+    GST_WARNING_OBJECT (mux, "Dropping packet of %" G_GSIZE_FORMAT " bytes on slot %u",
+        size, slot);
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+
+  gst_buffer_unmap (buf, &map);
+
+  return buf;
+}
+
+static GstFlowReturn
+gst_discord_crypto_mux_aggregate (GstAggregator * agg, gboolean timeout)
+{
+  GstDiscordcryptomux *mux = GST_DISCORDCRYPTOMUX (agg);
+
+  GstBufferList *list = gst_buffer_list_new ();
+  gboolean eos = TRUE;
+
+  GST_OBJECT_LOCK (mux);
+  for (GList *l = GST_ELEMENT (mux)->sinkpads; l; l = l->next) {
+    GstDiscordcryptomuxPad *pad = l->data;
+    GstBuffer *buf;
+
+    if (G_UNLIKELY (g_atomic_int_compare_and_exchange (&pad->changed, TRUE, FALSE)))
+      gst_discord_crypto_mux_apply (mux, pad);
+
+    while ((buf = gst_aggregator_pad_pop_buffer (GST_AGGREGATOR_PAD (pad)))) {
+      buf = gst_discord_crypto_mux_encrypt (mux, pad->slot, buf);
+      if (buf)
+        gst_buffer_list_add (list, buf);
+    }
+
+    if (!gst_aggregator_pad_is_eos (GST_AGGREGATOR_PAD (pad)))
+      eos = FALSE;
+  }
+  GST_OBJECT_UNLOCK (mux);
+
+  if (gst_buffer_list_length (list) == 0) {
+    gst_buffer_list_unref (list);
+    return eos ? GST_FLOW_EOS : GST_FLOW_OK;
+  }
+
+#if GST_CHECK_VERSION(1, 18, 0)
+  return gst_aggregator_finish_buffer_list (agg, list);
+#else
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint len = gst_buffer_list_length (list);
+  for (guint i = 0; i < len && ret == GST_FLOW_OK; i++)
+    ret = gst_aggregator_finish_buffer (agg, gst_buffer_ref (gst_buffer_list_get (list, i)));
+  gst_buffer_list_unref (list);
+  return ret;
+#endif
+}
+
+// the output is whatever the first negotiated input is
+static GstFlowReturn
+gst_discord_crypto_mux_update_src_caps (GstAggregator * agg, GstCaps * caps, GstCaps ** ret)
+{
+  GstCaps *sink_caps = NULL;
+
+  GST_OBJECT_LOCK (agg);
+  for (GList *l = GST_ELEMENT (agg)->sinkpads; l && !sink_caps; l = l->next)
+    sink_caps = gst_pad_get_current_caps (GST_PAD (l->data));
+  GST_OBJECT_UNLOCK (agg);
+
+  if (!sink_caps)
+    return GST_AGGREGATOR_FLOW_NEED_DATA;
+
+  *ret = gst_caps_intersect (caps, sink_caps);
+  gst_caps_unref (sink_caps);
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,122 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDCRYPTOMUX_H__
+#define __GST_DISCORDCRYPTOMUX_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstaggregator.h>
+
+#include "gstdiscordcryptosession.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DISCORDCRYPTOMUX_PAD \
+  (gst_discord_crypto_mux_pad_get_type())
+#define GST_DISCORDCRYPTOMUX_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DISCORDCRYPTOMUX_PAD,GstDiscordcryptomuxPad))
+
+#define GST_TYPE_DISCORDCRYPTOMUX \
+  (gst_discord_crypto_mux_get_type())
+#define GST_DISCORDCRYPTOMUX(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DISCORDCRYPTOMUX,GstDiscordcryptomux))
+#define GST_DISCORDCRYPTOMUX_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_DISCORDCRYPTOMUX,GstDiscordcryptomuxClass))
+#define GST_IS_DISCORDCRYPTOMUX(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_DISCORDCRYPTOMUX))
+#define GST_IS_DISCORDCRYPTOMUX_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_DISCORDCRYPTOMUX))
+
+typedef struct _GstDiscordcryptomuxPad      GstDiscordcryptomuxPad;
+typedef struct _GstDiscordcryptomuxPadClass GstDiscordcryptomuxPadClass;
+typedef struct _GstDiscordcryptomux         GstDiscordcryptomux;
+typedef struct _GstDiscordcryptomuxClass    GstDiscordcryptomuxClass;
+
+/* One voice connection. The properties are only staged here under the pad's
+ * object lock, the streaming thread applies them to the mux's slot once
+ * changed is set. */
+struct _GstDiscordcryptomuxPad
+{
+  GstAggregatorPad parent;
+
+  guint slot;
+
+  GstDiscordcryptoPattern encryption;
+  guint8 key[32];
+  gboolean new_key;
+  gint changed;
+};
+
+struct _GstDiscordcryptomuxPadClass
+{
+  GstAggregatorPadClass parent_class;
+};
+
+struct _GstDiscordcryptomux
+{
+  GstAggregator element;
+
+  // per pad state indexed by slot, kept in parallel arrays so the loop
+  // over every pad only pulls in what it reads. Resized under the object
+  // lock, which the streaming loop holds.
+  guint n_slots;
+  gboolean *used;
+  gboolean *has_keys;
+  GstDiscordcryptoPattern *encryptions;
+  gsize *trailer_sizes;
+  GstDiscordcryptoSession *sessions;
+};
+
+struct _GstDiscordcryptomuxClass
+{
+  GstAggregatorClass parent_class;
+};
+
+GType gst_discord_crypto_mux_pad_get_type (void);
+GType gst_discord_crypto_mux_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDCRYPTOMUX_H__ */
@@ -0,0 +1,665 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include <sodium.h>
+
+#include "gstdiscordcryptosession.h"
+#include "gstdiscordcryptoarena.h"
+
+GType
+gst_discord_crypto_pattern_get_type (void)
+{
+  static GType discord_crypto_pattern_type = 0;
+
+  if (!discord_crypto_pattern_type) {
+    static GEnumValue pattern_types[] = {
+      { GST_DISCORDCRYPTO_XSALSA20_POLY1305, "xsalsa20_poly1305", "xsalsa20_poly1305" },
+      { GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX, "xsalsa20_poly1305_suffix", "xsalsa20_poly1305_suffix" },
+      { GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE, "xsalsa20_poly1305_lite", "xsalsa20_poly1305_lite" },
+      { GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE, "aead_aes256_gcm_rtpsize", "aead_aes256_gcm_rtpsize" },
+      { GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE, "aead_xchacha20_poly1305_rtpsize", "aead_xchacha20_poly1305_rtpsize" },
+      { 0, NULL, NULL },
+    };
+
+    discord_crypto_pattern_type =
+      g_enum_register_static ("GstDiscordcryptoPattern", pattern_types);
+  }
+
+  return discord_crypto_pattern_type;
+}
+
+gsize
+gst_discord_crypto_trailer_size (GstDiscordcryptoPattern encryption)
+{
+  switch (encryption) {
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305:
+      return crypto_secretbox_MACBYTES;
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX:
+      return crypto_secretbox_MACBYTES + crypto_secretbox_NONCEBYTES;
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE:
+      return crypto_secretbox_MACBYTES + 4;
+    case GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE:
+      return crypto_aead_aes256gcm_ABYTES + 4;
+    case GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE:
+      return crypto_aead_xchacha20poly1305_ietf_ABYTES + 4;
+  }
+
+  return crypto_secretbox_MACBYTES + crypto_secretbox_NONCEBYTES;
+}
+
+static GMutex nonce_groups_lock;
+static GHashTable *nonce_groups;
+
+GstDiscordcryptoNonceGroup *
+gst_discord_crypto_nonce_group_get (const gchar * name, guint32 start)
+{
+  GstDiscordcryptoNonceGroup *group;
+
+  g_mutex_lock (&nonce_groups_lock);
+  if (!nonce_groups)
+    nonce_groups = g_hash_table_new (g_str_hash, g_str_equal);
+
+  group = g_hash_table_lookup (nonce_groups, name);
+  if (group) {
+    group->refcount++;
+  } else {
+    group = g_new0 (GstDiscordcryptoNonceGroup, 1);
+    group->name = g_strdup (name);
+    group->refcount = 1;
+    group->next = start;
+    g_hash_table_insert (nonce_groups, group->name, group);
+  }
+  g_mutex_unlock (&nonce_groups_lock);
+
+  return group;
+}
+
+GstDiscordcryptoNonceGroup *
+gst_discord_crypto_nonce_group_ref (GstDiscordcryptoNonceGroup * group)
+{
+  g_mutex_lock (&nonce_groups_lock);
+  group->refcount++;
+  g_mutex_unlock (&nonce_groups_lock);
+
+  return group;
+}
+
+// raises the counter to at least nonce, other elements may be taking
+// ranges at the same time
+static void
+gst_discord_crypto_nonce_group_advance (GstDiscordcryptoNonceGroup * group, guint32 nonce)
+{
+  guint next;
+
+  do {
+    next = (guint) g_atomic_int_get ((gint *) &group->next);
+  } while (next < nonce &&
+      !g_atomic_int_compare_and_exchange ((gint *) &group->next, (gint) next, (gint) nonce));
+}
+
+void
+gst_discord_crypto_nonce_group_unref (GstDiscordcryptoNonceGroup * group)
+{
+  g_mutex_lock (&nonce_groups_lock);
+  if (--group->refcount == 0) {
+    g_hash_table_remove (nonce_groups, group->name);
+    g_free (group->name);
+    g_free (group);
+  }
+  g_mutex_unlock (&nonce_groups_lock);
+}
+
+void
+gst_discord_crypto_keyring_init (GstDiscordcryptoKeyring * ring)
+{
+  ring->slots[0] = gst_discord_crypto_arena_alloc (sizeof (GstDiscordcryptoSession));
+  ring->slots[1] = gst_discord_crypto_arena_alloc (sizeof (GstDiscordcryptoSession));
+  ring->readers[0] = ring->readers[1] = 0;
+  ring->active = 0;
+  ring->keyed = FALSE;
+  ring->streaming = FALSE;
+  ring->nonce_start = 0;
+  ring->group = NULL;
+  ring->live_group = NULL;
+  g_mutex_init (&ring->lock);
+}
+
+void
+gst_discord_crypto_keyring_clear (GstDiscordcryptoKeyring * ring)
+{
+  gst_discord_crypto_arena_free (ring->slots[0], sizeof (GstDiscordcryptoSession));
+  gst_discord_crypto_arena_free (ring->slots[1], sizeof (GstDiscordcryptoSession));
+  ring->slots[0] = ring->slots[1] = NULL;
+  if (ring->group)
+    gst_discord_crypto_nonce_group_unref (ring->group);
+  if (ring->live_group)
+    gst_discord_crypto_nonce_group_unref (ring->live_group);
+  g_mutex_clear (&ring->lock);
+}
+
+static gboolean probed_gcm = FALSE;
+static const gchar *probed_kernel = "scalar";
+
+gboolean
+gst_discord_crypto_probe (void)
+{
+  if (sodium_init () == -1)
+    return FALSE;
+
+  // the same checks libsodium makes when it picks its implementations
+  probed_gcm = crypto_aead_aes256gcm_is_available ();
+  if (probed_gcm)
+#if defined(__aarch64__)
+    probed_kernel = "armcrypto";
+#else
+    probed_kernel = "aesni";
+#endif
+  else if (sodium_runtime_has_avx2 ())
+    probed_kernel = "avx2";
+  else if (sodium_runtime_has_ssse3 ())
+    probed_kernel = "ssse3";
+
+  return TRUE;
+}
+
+gboolean
+gst_discord_crypto_has_gcm (void)
+{
+  return probed_gcm;
+}
+
+const gchar *
+gst_discord_crypto_kernel (void)
+{
+  return probed_kernel;
+}
+
+void
+gst_discord_crypto_session_init (GstDiscordcryptoSession * session, const guint8 * key)
+{
+  // if the key changes the nonces need to be reset
+  sodium_memzero (session, sizeof *session);
+  memcpy (session->key, key, 32);
+
+  // expand the AES key schedule once instead of per packet
+  session->has_gcm = gst_discord_crypto_has_gcm ();
+  if (session->has_gcm)
+    crypto_aead_aes256gcm_beforenm(&session->gcm, session->key);
+}
+
+// must be called with the lock held. The counter carries on from nonce,
+// which has to be past every nonce already sent if key is the key in use.
+static void
+gst_discord_crypto_keyring_publish_locked (GstDiscordcryptoKeyring * ring, const guint8 * key,
+    guint32 nonce)
+{
+  // nobody reads the spare slot, the last publish waited its readers out
+  gint old = ring->active;
+  GstDiscordcryptoSession *session = ring->slots[!old];
+  GstDiscordcryptoNonceGroup *old_group = ring->live_group;
+  gst_discord_crypto_session_init (session, key);
+
+  // with a group the first packet takes a range, never one below nonce
+  session->lite_nonce = session->lite_end = nonce;
+  session->group = ring->group;
+  if (ring->group)
+    gst_discord_crypto_nonce_group_advance (ring->group, nonce);
+  ring->live_group = ring->group ? gst_discord_crypto_nonce_group_ref (ring->group) : NULL;
+  ring->keyed = TRUE;
+
+  g_atomic_int_set (&ring->active, !old);
+
+  // grace period, packets already using the old key finish with it
+  while (g_atomic_int_get (&ring->readers[old]) > 0)
+    g_thread_yield ();
+  sodium_memzero (ring->slots[old], sizeof *ring->slots[old]);
+
+  if (old_group)
+    gst_discord_crypto_nonce_group_unref (old_group);
+}
+
+static void
+gst_discord_crypto_keyring_publish (GstDiscordcryptoKeyring * ring, const guint8 * key)
+{
+  g_mutex_lock (&ring->lock);
+  // a new key, its nonces start over
+  gst_discord_crypto_keyring_publish_locked (ring, key, ring->nonce_start);
+  g_mutex_unlock (&ring->lock);
+}
+
+// must be called with the lock held. Restarts the current key without
+// reusing a nonce, only while nothing streams so the counter holds still.
+// Returns the counter it carries on from.
+static guint32
+gst_discord_crypto_keyring_restart_locked (GstDiscordcryptoKeyring * ring)
+{
+  GstDiscordcryptoSession *session = ring->slots[ring->active];
+  guint32 nonce = MAX (ring->nonce_start, session->lite_nonce);
+  guint8 key[32];
+
+  // other elements in the group may have gone further with this key
+  if (session->group)
+    nonce = MAX (nonce, (guint32) g_atomic_int_get ((gint *) &session->group->next));
+
+  memcpy (key, session->key, sizeof key);
+  gst_discord_crypto_keyring_publish_locked (ring, key, nonce);
+  sodium_memzero (key, sizeof key);
+
+  return nonce;
+}
+
+void
+gst_discord_crypto_keyring_set_streaming (GstDiscordcryptoKeyring * ring, gboolean streaming)
+{
+  g_mutex_lock (&ring->lock);
+  ring->streaming = streaming;
+  g_mutex_unlock (&ring->lock);
+}
+
+gboolean
+gst_discord_crypto_keyring_set_nonce_start (GstDiscordcryptoKeyring * ring, guint32 start)
+{
+  gboolean applied = TRUE;
+
+  g_mutex_lock (&ring->lock);
+  ring->nonce_start = start;
+  if (ring->keyed && ring->streaming)
+    applied = FALSE;
+  else if (ring->keyed)
+    applied = gst_discord_crypto_keyring_restart_locked (ring) == start;
+  g_mutex_unlock (&ring->lock);
+
+  return applied;
+}
+
+guint32
+gst_discord_crypto_keyring_get_nonce_start (GstDiscordcryptoKeyring * ring)
+{
+  g_mutex_lock (&ring->lock);
+  guint32 start = ring->nonce_start;
+  g_mutex_unlock (&ring->lock);
+
+  return start;
+}
+
+gboolean
+gst_discord_crypto_keyring_set_group (GstDiscordcryptoKeyring * ring, const gchar * name)
+{
+  gboolean applied = TRUE;
+
+  g_mutex_lock (&ring->lock);
+  GstDiscordcryptoNonceGroup *old = ring->group;
+  ring->group = name ? gst_discord_crypto_nonce_group_get (name, ring->nonce_start) : NULL;
+  if (old)
+    gst_discord_crypto_nonce_group_unref (old);
+
+  if (ring->keyed && ring->streaming)
+    applied = FALSE;
+  else if (ring->keyed)
+    gst_discord_crypto_keyring_restart_locked (ring);
+  g_mutex_unlock (&ring->lock);
+
+  return applied;
+}
+
+guint32
+gst_discord_crypto_keyring_get_nonce (GstDiscordcryptoKeyring * ring)
+{
+  gint slot;
+  GstDiscordcryptoSession *session = gst_discord_crypto_keyring_acquire (ring, &slot);
+
+  // a group hasn't handed out the range yet
+  guint32 nonce = session->group && session->lite_nonce == session->lite_end ?
+      (guint32) g_atomic_int_get ((gint *) &session->group->next) :
+      (guint32) g_atomic_int_get ((gint *) &session->lite_nonce);
+
+  gst_discord_crypto_keyring_release (ring, slot);
+
+  return nonce;
+}
+
+gboolean
+gst_discord_crypto_keyring_set_key (GstDiscordcryptoKeyring * ring,
+    const GValue * value)
+{
+  guint8 key[32];
+
+  if (gst_value_array_get_size(value) < 32)
+    return FALSE;
+
+  for (int i = 0; i < 32; i++) {
+    const GValue *val = gst_value_array_get_value(value, i);
+    key[i] = g_value_get_uint(val);
+  }
+
+  gst_discord_crypto_keyring_publish (ring, key);
+  sodium_memzero (key, sizeof key);
+
+  return TRUE;
+}
+
+gboolean
+gst_discord_crypto_keyring_set_key_bytes (GstDiscordcryptoKeyring * ring,
+    GBytes * key)
+{
+  gsize size;
+  const guint8 *data = key ? g_bytes_get_data (key, &size) : NULL;
+
+  if (!data || size < 32)
+    return FALSE;
+
+  gst_discord_crypto_keyring_publish (ring, data);
+
+  return TRUE;
+}
+
+void
+gst_discord_crypto_keyring_get_key (GstDiscordcryptoKeyring * ring,
+    GValue * value)
+{
+  GValue val = G_VALUE_INIT;
+  g_value_init(&val, G_TYPE_UINT);
+
+  // writers are the only ones changing the key
+  g_mutex_lock (&ring->lock);
+  for (int i = 0; i < 32; i++) {
+    g_value_set_uint(&val, ring->slots[ring->active]->key[i]);
+    gst_value_array_append_value(value, &val);
+  }
+  g_mutex_unlock (&ring->lock);
+
+  g_value_unset(&val);
+}
+
+static void
+gst_discord_crypto_session_refill_nonces (GstDiscordcryptoSession * session)
+{
+  static const guint8 zero[crypto_stream_chacha20_NONCEBYTES] = {0};
+  guint8 stream[crypto_stream_chacha20_KEYBYTES + sizeof session->suffix_nonces];
+
+  // the only syscall, once per key
+  if (!session->suffix_seeded) {
+    randombytes_buf(session->suffix_seed, sizeof session->suffix_seed);
+    session->suffix_seeded = TRUE;
+  }
+
+  // the start of the stream replaces the seed, so nonces already sent
+  // can't be used to work out the ones that follow
+  crypto_stream_chacha20(stream, sizeof stream, zero, session->suffix_seed);
+  memcpy(session->suffix_seed, stream, sizeof session->suffix_seed);
+  memcpy(session->suffix_nonces, stream + sizeof session->suffix_seed,
+      sizeof session->suffix_nonces);
+  sodium_memzero(stream, sizeof stream);
+
+  session->suffix_remaining = GST_DISCORDCRYPTO_SUFFIX_NONCES;
+}
+
+// fills in the nonce for the next packet, returns how many of its bytes
+// are sent behind the packet
+static gsize
+gst_discord_crypto_session_next_nonce (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, const guint8 * header, guint8 * nonce)
+{
+  switch (encryption) {
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305:
+      memcpy(nonce, header, RTP_HEADER_SIZE);
+      return 0;
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX:
+      if (G_UNLIKELY (session->suffix_remaining == 0))
+        gst_discord_crypto_session_refill_nonces (session);
+      session->suffix_remaining--;
+      memcpy(nonce, session->suffix_nonces + session->suffix_remaining * 24, 24);
+      return 24;
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE:
+    case GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE:
+    case GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE:
+      if (session->group && G_UNLIKELY (session->lite_nonce == session->lite_end)) {
+        session->lite_nonce = g_atomic_int_add ((gint *) &session->group->next,
+            GST_DISCORDCRYPTO_NONCE_RANGE);
+        session->lite_end = session->lite_nonce + GST_DISCORDCRYPTO_NONCE_RANGE;
+      }
+      // the counter followed by zeros, wraps back to 0 after 2^32 - 1
+      ((guint32 *)&nonce[0])[0] = g_htonl(session->lite_nonce++);
+      return 4;
+  }
+
+  return 0;
+}
+
+gboolean
+gst_discord_crypto_session_encrypt (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint8 * packet, gsize header_size, gsize size)
+{
+  guint8 nonce[24] = {0};
+
+  guint8 *data = packet + header_size;
+  gsize data_size = size - header_size;
+  // the nonce goes behind the tag in every mode
+  guint8 *tail = packet + size + crypto_secretbox_MACBYTES;
+
+  // header stays in the clear as associated data, the payload is
+  // encrypted where it is and the tag lands right behind it
+  if (gst_discord_crypto_is_rtpsize (encryption))
+    return gst_discord_crypto_session_encrypt_detached (session, encryption,
+        packet, header_size, data, data_size, data + data_size, tail);
+
+  gsize nonce_size = gst_discord_crypto_session_next_nonce (session, encryption, packet, nonce);
+  crypto_secretbox_easy(data, data, data_size, nonce, session->key);
+  memcpy(tail, nonce, nonce_size);
+
+  return TRUE;
+}
+
+void
+gst_discord_crypto_session_encrypt_keystream (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint8 * packet, gsize header_size, gsize size,
+    const guint8 * stream)
+{
+  static const guint8 pad[16] = {0};
+  guint8 nonce[24] = {0};
+
+  guint8 *data = packet + header_size;
+  gsize data_size = size - header_size;
+  guint8 *tail = packet + size + crypto_secretbox_MACBYTES;
+
+  gsize nonce_size = gst_discord_crypto_session_next_nonce (session, encryption, packet, nonce);
+
+  // the first 32 bytes are the poly1305 key in both modes
+  if (encryption == GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE) {
+    // laid out like crypto_secretbox_easy, the tag in front
+    guint8 *c = data + crypto_secretbox_MACBYTES;
+    memmove(c, data, data_size);
+    for (gsize i = 0; i < data_size; i++)
+      c[i] ^= stream[32 + i];
+    crypto_onetimeauth_poly1305(data, c, data_size, stream);
+  } else {
+    // the ietf aead construction over the clear header and the ciphertext
+    crypto_onetimeauth_poly1305_state state;
+    guint8 lengths[16];
+
+    for (gsize i = 0; i < data_size; i++)
+      data[i] ^= stream[64 + i];
+
+    GST_WRITE_UINT64_LE (lengths, header_size);
+    GST_WRITE_UINT64_LE (lengths + 8, data_size);
+    crypto_onetimeauth_poly1305_init(&state, stream);
+    crypto_onetimeauth_poly1305_update(&state, packet, header_size);
+    crypto_onetimeauth_poly1305_update(&state, pad, (0x10 - header_size) & 0xf);
+    crypto_onetimeauth_poly1305_update(&state, data, data_size);
+    crypto_onetimeauth_poly1305_update(&state, pad, (0x10 - data_size) & 0xf);
+    crypto_onetimeauth_poly1305_update(&state, lengths, sizeof lengths);
+    crypto_onetimeauth_poly1305_final(&state, data + data_size);
+    sodium_memzero(&state, sizeof state);
+  }
+  memcpy(tail, nonce, nonce_size);
+}
+
+void
+gst_discord_crypto_session_encrypt_lanes (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint8 * const packets[],
+    const gsize header_sizes[], const gsize sizes[], guint n)
+{
+  guint8 nonces[GST_DISCORDCRYPTO_LANES][24] = {{0}};
+  gsize nonce_sizes[GST_DISCORDCRYPTO_LANES];
+  const guint8 *nonce_ptrs[GST_DISCORDCRYPTO_LANES];
+  guint8 *data[GST_DISCORDCRYPTO_LANES];
+  gsize data_sizes[GST_DISCORDCRYPTO_LANES];
+
+  g_return_if_fail (n <= GST_DISCORDCRYPTO_LANES && !gst_discord_crypto_is_rtpsize (encryption));
+
+  // nonces are handed out in packet order, like one call per packet would
+  for (guint i = 0; i < n; i++) {
+    nonce_sizes[i] = gst_discord_crypto_session_next_nonce (session, encryption,
+        packets[i], nonces[i]);
+    nonce_ptrs[i] = nonces[i];
+    data[i] = packets[i] + header_sizes[i];
+    data_sizes[i] = sizes[i] - header_sizes[i];
+  }
+
+  gst_discord_crypto_secretbox_lanes (data, data_sizes, nonce_ptrs, n, session->key);
+
+  for (guint i = 0; i < n; i++)
+    memcpy(packets[i] + sizes[i] + crypto_secretbox_MACBYTES, nonces[i], nonce_sizes[i]);
+}
+
+gboolean
+gst_discord_crypto_session_encrypt_detached (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, const guint8 * header, gsize header_size,
+    guint8 * payload, gsize payload_size, guint8 * mac, guint8 * tail)
+{
+  guint8 nonce[24] = {0};
+
+  gboolean gcm = encryption == GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE;
+  if (gcm && !session->has_gcm)
+    return FALSE;
+
+  gsize nonce_size = gst_discord_crypto_session_next_nonce (session, encryption, header, nonce);
+
+  // 12 of the nonce bytes are used for GCM and all 24 for XChaCha20
+  if (gcm) {
+    crypto_aead_aes256gcm_encrypt_detached_afternm(payload, mac, NULL,
+        payload, payload_size, header, header_size, NULL, nonce, &session->gcm);
+  } else if (gst_discord_crypto_is_rtpsize (encryption)) {
+    crypto_aead_xchacha20poly1305_ietf_encrypt_detached(payload, mac, NULL,
+        payload, payload_size, header, header_size, NULL, nonce, session->key);
+  } else {
+    crypto_secretbox_detached(payload, mac, payload, payload_size, nonce, session->key);
+  }
+  memcpy(tail, nonce, nonce_size);
+
+  return TRUE;
+}
+
+gboolean
+gst_discord_crypto_session_decrypt (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint8 * packet, gsize header_size, gsize size,
+    gsize * out_size)
+{
+  guint8 nonce[24] = {0};
+
+  // cheapest check first, anything shorter can't carry a valid tag
+  if (size < header_size + gst_discord_crypto_trailer_size (encryption))
+    return FALSE;
+
+  guint8 *data = packet + header_size;
+  gsize data_size = size - header_size;
+
+  switch (encryption) {
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305: {
+      memcpy(nonce, packet, RTP_HEADER_SIZE);
+      break;
+    }
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX: {
+      data_size -= 24;
+      memcpy(nonce, packet + (size - 24), 24);
+      break;
+    }
+    case GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE: {
+      data_size -= 4;
+      memcpy(nonce, packet + (size - 4), 4);
+      break;
+    }
+    case GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE:
+    case GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE: {
+      gboolean gcm = encryption == GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE;
+      int ret;
+
+      if (gcm && !session->has_gcm)
+        return FALSE;
+
+      data_size -= crypto_aead_aes256gcm_ABYTES + 4;
+      memcpy(nonce, packet + (size - 4), 4);
+
+      // the tag is checked before anything is written
+      if (gcm) {
+        ret = crypto_aead_aes256gcm_decrypt_detached_afternm(data, NULL,
+            data, data_size, data + data_size, packet, header_size, nonce, &session->gcm);
+      } else {
+        ret = crypto_aead_xchacha20poly1305_ietf_decrypt_detached(data, NULL,
+            data, data_size, data + data_size, packet, header_size, nonce, session->key);
+      }
+      if (ret != 0)
+        return FALSE;
+
+      *out_size = header_size + data_size;
+      return TRUE;
+    }
+  }
+
+  // the mac is verified before the payload is moved over it
+  if (crypto_secretbox_open_easy(data, data, data_size, nonce, session->key) != 0)
+    return FALSE;
+
+  *out_size = header_size + data_size - crypto_secretbox_MACBYTES;
+  return TRUE;
+}
@@ -0,0 +1,300 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDCRYPTO_SESSION_H__
+#define __GST_DISCORDCRYPTO_SESSION_H__
+
+#include <gst/gst.h>
+
+#include <sodium.h>
+
+#include "gstdiscordcryptolanes.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  GST_DISCORDCRYPTO_XSALSA20_POLY1305,
+  GST_DISCORDCRYPTO_XSALSA20_POLY1305_SUFFIX,
+  GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE,
+  GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE,
+  GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE
+} GstDiscordcryptoPattern;
+
+#define GST_TYPE_DISCORDCRYPTO_PATTERN (gst_discord_crypto_pattern_get_type ())
+GType gst_discord_crypto_pattern_get_type (void);
+
+#define RTP_HEADER_SIZE 12
+
+// suffix nonces generated at once, one refill every this many packets
+#define GST_DISCORDCRYPTO_SUFFIX_NONCES 64
+
+static inline gboolean
+gst_discord_crypto_is_rtpsize (GstDiscordcryptoPattern encryption)
+{
+  return encryption == GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE ||
+      encryption == GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE;
+}
+
+/*
+ * Size of the part of an RTP packet that is sent in the clear. The
+ * xsalsa20_poly1305 modes only keep the fixed header (Discord encrypts
+ * everything behind it), the rtpsize modes also keep the csrcs and the
+ * 4 byte extension header, only the extension data is encrypted.
+ *
+ * Returns 0 for anything that isn't a version 2 RTP packet that large.
+ */
+static inline gsize
+gst_discord_crypto_header_size (const guint8 *data, gsize size, gboolean rtpsize)
+{
+  gsize header_size = RTP_HEADER_SIZE;
+
+  if (G_UNLIKELY (size < RTP_HEADER_SIZE || (data[0] >> 6) != 2))
+    return 0;
+
+  if (rtpsize) {
+    header_size += (data[0] & 0x0f) * 4;
+    if (data[0] & 0x10)
+      header_size += 4;
+  }
+
+  return G_LIKELY (header_size <= size) ? header_size : 0;
+}
+
+// lite counters a nonce group hands out at once
+#define GST_DISCORDCRYPTO_NONCE_RANGE 1024
+
+/*
+ * Counter shared by every element streaming with the same key, each takes
+ * ranges of GST_DISCORDCRYPTO_NONCE_RANGE nonces from it with one atomic
+ * add so their packets never share a nonce. Looked up by name, process wide.
+ */
+typedef struct {
+  gchar *name;
+  gint refcount;
+  guint next;
+} GstDiscordcryptoNonceGroup;
+
+// the group called name, made with its counter at start if it is new
+GstDiscordcryptoNonceGroup *gst_discord_crypto_nonce_group_get (const gchar * name,
+    guint32 start);
+GstDiscordcryptoNonceGroup *gst_discord_crypto_nonce_group_ref (GstDiscordcryptoNonceGroup * group);
+void gst_discord_crypto_nonce_group_unref (GstDiscordcryptoNonceGroup * group);
+
+/*
+ * State derived from the key, rebuilt in a spare slot of the keyring
+ * whenever a key is set so the streaming thread never sees it half written.
+ *
+ * The HSalsa20 subkey is deliberately not cached: it is derived from the
+ * first 16 nonce bytes, which hold the lite counter, the RTP header or
+ * random bytes depending on the mode, so it changes with every packet.
+ */
+typedef struct {
+  guint8 key[32];
+  // lite nonce, also the counter nonce of the rtpsize modes
+  guint32 lite_nonce;
+  // with a group the counter runs up to lite_end before taking a new range
+  guint32 lite_end;
+  GstDiscordcryptoNonceGroup *group;
+
+  // suffix nonces cut from a ChaCha20 keystream instead of asking the os
+  // for every packet, the stream is reseeded from itself on each refill
+  gboolean suffix_seeded;
+  guint suffix_remaining;
+  guint8 suffix_seed[crypto_stream_chacha20_KEYBYTES];
+  guint8 suffix_nonces[GST_DISCORDCRYPTO_SUFFIX_NONCES * crypto_secretbox_NONCEBYTES];
+
+  // expanded AES key, only valid if the cpu has AES-NI/PMULL
+  gboolean has_gcm;
+  crypto_aead_aes256gcm_state gcm;
+} GstDiscordcryptoSession;
+
+// largest packet the elements take in, bigger ones are dropped or, in
+// discordcrypto, left to the base class. Every buffer a packet is encrypted
+// into has MAX_TRAILER_SIZE more room than that.
+#define MAX_PACKET_SIZE 1500
+// worst case growth of a packet, mac plus a full suffix nonce
+#define MAX_TRAILER_SIZE (crypto_secretbox_MACBYTES + crypto_secretbox_NONCEBYTES)
+
+gsize gst_discord_crypto_trailer_size (GstDiscordcryptoPattern encryption);
+
+/*
+ * Initializes libsodium once for the process, which picks its stream and
+ * aead implementations for the cpu, and remembers what was picked. Called
+ * from plugin_init before any element class exists.
+ */
+gboolean gst_discord_crypto_probe (void);
+// AES-256-GCM is usable on this cpu
+gboolean gst_discord_crypto_has_gcm (void);
+// fastest kernel found by the probe: "aesni" or "armcrypto" (AES-256-GCM),
+// "avx2", "ssse3" or "scalar"
+const gchar *gst_discord_crypto_kernel (void);
+
+// wipes a session and sets it up for a 32 byte key, nonces start over
+void gst_discord_crypto_session_init (GstDiscordcryptoSession * session,
+    const guint8 * key);
+
+/*
+ * Two sessions so a new key can be prepared while packets are still being
+ * handled with the old one. Readers never lock, they pin the active slot by
+ * bumping its reader count. Writers fill the other slot, publish it with one
+ * atomic store and wipe the old slot once its readers are gone.
+ */
+typedef struct {
+  // in the secure arena, away from the element and each other
+  GstDiscordcryptoSession *slots[2];
+  gint readers[2];
+  gint active;
+  // serialises writers, never taken on the streaming thread
+  GMutex lock;
+  gboolean keyed;
+  // set while packets may be encrypted, the counter can't be read then
+  gboolean streaming;
+  // where the counter of the next key starts, or the group it takes its
+  // nonces from
+  guint32 nonce_start;
+  GstDiscordcryptoNonceGroup *group;
+  // the group the current sessions take their nonces from
+  GstDiscordcryptoNonceGroup *live_group;
+} GstDiscordcryptoKeyring;
+
+void gst_discord_crypto_keyring_init (GstDiscordcryptoKeyring * ring);
+void gst_discord_crypto_keyring_clear (GstDiscordcryptoKeyring * ring);
+
+// both return FALSE for keys shorter than 32 bytes, the old key stays then
+gboolean gst_discord_crypto_keyring_set_key (GstDiscordcryptoKeyring * ring,
+    const GValue * value);
+gboolean gst_discord_crypto_keyring_set_key_bytes (GstDiscordcryptoKeyring * ring,
+    GBytes * key);
+void gst_discord_crypto_keyring_get_key (GstDiscordcryptoKeyring * ring,
+    GValue * value);
+
+/*
+ * Nonces are never reused with a key. While streaming, a new nonce start or
+ * group only applies from the next key on. Otherwise the current key is
+ * restarted there too, but its counter only moves forward: it carries on
+ * from the furthest of the start, its own counter and its old group. Both
+ * return FALSE if the current key doesn't continue exactly as asked.
+ */
+void gst_discord_crypto_keyring_set_streaming (GstDiscordcryptoKeyring * ring,
+    gboolean streaming);
+gboolean gst_discord_crypto_keyring_set_nonce_start (GstDiscordcryptoKeyring * ring,
+    guint32 start);
+guint32 gst_discord_crypto_keyring_get_nonce_start (GstDiscordcryptoKeyring * ring);
+// the group called name, a new one starts at the nonce start, NULL leaves it
+gboolean gst_discord_crypto_keyring_set_group (GstDiscordcryptoKeyring * ring,
+    const gchar * name);
+
+// the counter the next packet is sent with
+guint32 gst_discord_crypto_keyring_get_nonce (GstDiscordcryptoKeyring * ring);
+
+// the session stays valid and keeps its key until it is released
+static inline GstDiscordcryptoSession *
+gst_discord_crypto_keyring_acquire (GstDiscordcryptoKeyring * ring, gint * slot)
+{
+  for (;;) {
+    gint i = g_atomic_int_get (&ring->active);
+    g_atomic_int_inc (&ring->readers[i]);
+    // a writer that swapped in between won't wait for us, try the new slot
+    if (G_LIKELY (g_atomic_int_get (&ring->active) == i)) {
+      *slot = i;
+      return ring->slots[i];
+    }
+    g_atomic_int_add (&ring->readers[i], -1);
+  }
+}
+
+static inline void
+gst_discord_crypto_keyring_release (GstDiscordcryptoKeyring * ring, gint slot)
+{
+  g_atomic_int_add (&ring->readers[slot], -1);
+}
+
+/*
+ * Encrypts size bytes of packet in place, header_size of them being the
+ * clear header. The packet must have room for the trailer behind it.
+ */
+gboolean gst_discord_crypto_session_encrypt (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint8 * packet, gsize header_size, gsize size);
+
+/*
+ * Same as gst_discord_crypto_session_encrypt for the lite and xchacha20
+ * rtpsize modes with the keystream of the next nonce computed ahead of
+ * time, see GstDiscordcryptoKeystream. Only the xor and the tag are left.
+ */
+void gst_discord_crypto_session_encrypt_keystream (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint8 * packet, gsize header_size, gsize size,
+    const guint8 * stream);
+
+/*
+ * Encrypts n packets of one of the xsalsa20_poly1305 modes with the
+ * vectorized kernel, the same as gst_discord_crypto_session_encrypt on
+ * each of them in order. n is at most GST_DISCORDCRYPTO_LANES.
+ */
+void gst_discord_crypto_session_encrypt_lanes (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint8 * const packets[],
+    const gsize header_sizes[], const gsize sizes[], guint n);
+
+/*
+ * Same as gst_discord_crypto_session_encrypt for a packet that isn't
+ * contiguous. The payload is encrypted where it is, the 16 byte tag is
+ * written to mac and the nonce bytes sent behind the packet (trailer size
+ * minus the tag) to tail. Discord puts the tag in front of the payload for
+ * the xsalsa20_poly1305 modes and behind it for the rtpsize modes.
+ */
+gboolean gst_discord_crypto_session_encrypt_detached (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, const guint8 * header, gsize header_size,
+    guint8 * payload, gsize payload_size, guint8 * mac, guint8 * tail);
+
+/*
+ * Verifies and decrypts a packet in place, the plaintext ends up right
+ * behind the header. Returns FALSE for short or forged packets.
+ */
+gboolean gst_discord_crypto_session_decrypt (GstDiscordcryptoSession * session,
+    GstDiscordcryptoPattern encryption, guint8 * packet, gsize header_size, gsize size,
+    gsize * out_size);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDCRYPTO_SESSION_H__ */
@@ -0,0 +1,603 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/** * SECTION:element-discordcryptosink
+ *
+ * Encrypts opus data for Discord and sends it straight to the voice server,
+ * replacing discordcrypto ! udpsink. With batch-interval set, packets of
+ * every sink sharing a socket are queued and sent with one sendmmsg per
+ * interval instead of one syscall per packet.
+ *
+ * <refsect2>
+ * <title>Example of sending with ssrc and key being obtained from Discord</title>
+ * |[
+ * gst-launch-1.0 -v audiotestsrc ! audioconvert ! audioresample ! opusenc frame-size=60 ! \
+ *   rtpopuspay pt=120 ssrc=x ! discordcryptosink encryption=xsalsa20_poly1305_lite \
+ *   "key=<x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x>" \
+ *   host=127.0.0.1 port=1234 batch-interval=5000
+ * ]|
+ * </refsect2>
+ */
+
+// sendmmsg
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include <sodium.h>
+
+#include "gstdiscordcryptosink.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_discord_crypto_sink_debug);
+#define GST_CAT_DEFAULT gst_discord_crypto_sink_debug
+
+// messages per sendmmsg, a batch that fills up is sent early
+#define BATCH_SIZE 256
+
+#define DEFAULT_HOST "localhost"
+#define DEFAULT_PORT 5004
+
+enum
+{
+  PROP_0,
+  PROP_ENCRYPTION,
+  PROP_KEY,
+  PROP_HOST,
+  PROP_PORT,
+  PROP_SOCKET,
+  PROP_BATCH_INTERVAL
+};
+
+typedef struct {
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  gsize size;
+  guint8 data[MAX_PACKET_SIZE + MAX_TRAILER_SIZE];
+} GstDiscordcryptosinkMessage;
+
+struct _GstDiscordcryptosinkBatch
+{
+  GSocket *socket;
+  guint refcount;
+  // taken from the first sink on the socket
+  guint interval;
+
+  GMutex lock;
+  GCond cond;
+  GThread *thread;
+  gboolean running;
+
+  guint n_messages;
+  GstDiscordcryptosinkMessage messages[BATCH_SIZE];
+#ifdef __linux__
+  struct mmsghdr headers[BATCH_SIZE];
+  struct iovec iovecs[BATCH_SIZE];
+#endif
+};
+
+// one batch per socket, looked up by the GSocket
+static GMutex batches_lock;
+static GHashTable *batches;
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp, "
+        "media = (string) \"audio\", "
+        "payload = (int) " GST_RTP_PAYLOAD_DYNAMIC_STRING ", "
+        "clock-rate = (int) 48000, "
+        "encoding-params = (string) \"2\", "
+        "encoding-name = (string) { \"OPUS\", \"X-GST-OPUS-DRAFT-SPITTKA-00\" }")
+    );
+
+#define gst_discord_crypto_sink_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstDiscordcryptosink, gst_discord_crypto_sink, GST_TYPE_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (gst_discord_crypto_sink_debug, "discordcryptosink", 0,
+        "discordcryptosink"));
+
+static void gst_discord_crypto_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_discord_crypto_sink_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_discord_crypto_sink_finalize (GObject * object);
+
+static gboolean gst_discord_crypto_sink_start (GstBaseSink * bsink);
+static gboolean gst_discord_crypto_sink_stop (GstBaseSink * bsink);
+static GstFlowReturn gst_discord_crypto_sink_render (GstBaseSink * bsink, GstBuffer * buf);
+static GstFlowReturn gst_discord_crypto_sink_render_list (GstBaseSink * bsink,
+    GstBufferList * list);
+
+static void
+gst_discord_crypto_sink_class_init (GstDiscordcryptosinkClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+  GstBaseSinkClass *gstbasesink_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+  gstbasesink_class = (GstBaseSinkClass *) klass;
+
+  gobject_class->set_property = gst_discord_crypto_sink_set_property;
+  gobject_class->get_property = gst_discord_crypto_sink_get_property;
+  gobject_class->finalize = gst_discord_crypto_sink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_ENCRYPTION,
+      g_param_spec_enum ("encryption", "Encryption", "type of encryption to use",
+       GST_TYPE_DISCORDCRYPTO_PATTERN, GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(gobject_class, PROP_KEY,
+      gst_param_spec_array("key", "Key", "secret key from discord",
+         g_param_spec_uint("value", "val", "val", 0, 255, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS),
+         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_LAX_VALIDATION));
+
+  g_object_class_install_property (gobject_class, PROP_HOST,
+      g_param_spec_string ("host", "Host", "address of the voice server",
+       DEFAULT_HOST, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PORT,
+      g_param_spec_int ("port", "Port", "port of the voice server",
+       0, 65535, DEFAULT_PORT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SOCKET,
+      g_param_spec_object ("socket", "Socket",
+       "udp socket to send from, e.g. the one used for ip discovery (applied on start)",
+       G_TYPE_SOCKET, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BATCH_INTERVAL,
+      g_param_spec_uint ("batch-interval", "Batch interval",
+       "microseconds packets are queued for before being sent together with every "
+       "other sink on the same socket, 0 sends each packet right away (applied on start)",
+       0, G_USEC_PER_SEC, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_set_details_simple(gstelement_class,
+    "Discord Voice Sink",
+    "Sink/Network/Encryption/Audio",
+    "Encrypts opus data for Discord and sends it over udp",
+    "<<user@hostname.org>>");
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_factory));
+
+  gstbasesink_class->start = GST_DEBUG_FUNCPTR (gst_discord_crypto_sink_start);
+  gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_discord_crypto_sink_stop);
+  gstbasesink_class->render = GST_DEBUG_FUNCPTR (gst_discord_crypto_sink_render);
+  gstbasesink_class->render_list = GST_DEBUG_FUNCPTR (gst_discord_crypto_sink_render_list);
+}
+
+static void
+gst_discord_crypto_sink_init (GstDiscordcryptosink * sink)
+{
+  sink->encryption = GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE;
+  gst_discord_crypto_keyring_init (&sink->keys);
+
+  sink->host = g_strdup (DEFAULT_HOST);
+  sink->port = DEFAULT_PORT;
+}
+
+static void
+gst_discord_crypto_sink_finalize (GObject * object)
+{
+  GstDiscordcryptosink *sink = GST_DISCORDCRYPTOSINK (object);
+
+  gst_discord_crypto_keyring_clear (&sink->keys);
+  g_free (sink->host);
+  g_clear_object (&sink->socket);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_discord_crypto_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDiscordcryptosink *sink = GST_DISCORDCRYPTOSINK (object);
+
+  switch (prop_id) {
+    case PROP_ENCRYPTION:
+    {
+      GstDiscordcryptoPattern encryption = g_value_get_enum (value);
+      if (encryption == GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE &&
+          !gst_discord_crypto_has_gcm ()) {
+        GST_ELEMENT_WARNING (sink, LIBRARY, INIT,
+          (("AES-256-GCM is not supported by this CPU, using aead_xchacha20_poly1305_rtpsize")), (NULL));
+        encryption = GST_DISCORDCRYPTO_AEAD_XCHACHA20_POLY1305_RTPSIZE;
+      }
+      g_atomic_int_set ((gint *) &sink->encryption, encryption);
+      break;
+    }
+    case PROP_KEY:
+      if (!gst_discord_crypto_keyring_set_key (&sink->keys, value)) {
+        GST_ELEMENT_ERROR (sink, LIBRARY, INIT,
+          (("Specifed key too short")), (NULL));
+        return;
+      }
+      break;
+    case PROP_HOST:
+      g_free (sink->host);
+      sink->host = g_value_dup_string (value);
+      break;
+    case PROP_PORT:
+      sink->port = g_value_get_int (value);
+      break;
+    case PROP_SOCKET:
+      g_clear_object (&sink->socket);
+      sink->socket = g_value_dup_object (value);
+      break;
+    case PROP_BATCH_INTERVAL:
+      sink->batch_interval = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_discord_crypto_sink_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstDiscordcryptosink *sink = GST_DISCORDCRYPTOSINK (object);
+
+  switch (prop_id) {
+    case PROP_ENCRYPTION:
+      g_value_set_enum (value, g_atomic_int_get ((gint *) &sink->encryption));
+      break;
+    case PROP_KEY:
+      gst_discord_crypto_keyring_get_key (&sink->keys, value);
+      break;
+    case PROP_HOST:
+      g_value_set_string (value, sink->host);
+      break;
+    case PROP_PORT:
+      g_value_set_int (value, sink->port);
+      break;
+    case PROP_SOCKET:
+      g_value_set_object (value, sink->socket);
+      break;
+    case PROP_BATCH_INTERVAL:
+      g_value_set_uint (value, sink->batch_interval);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+// sends one datagram, waiting for room in the socket buffer. UDP is best
+// effort, anything but a full buffer just loses the packet.
+static void
+gst_discord_crypto_sink_send_one (GSocket * socket, const guint8 * data, gsize size,
+    const struct sockaddr_storage * addr, socklen_t addr_len)
+{
+  gint fd = g_socket_get_fd (socket);
+
+  for (;;) {
+    if (sendto (fd, data, size, 0, (const struct sockaddr *) addr, addr_len) >= 0)
+      return;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      g_socket_condition_wait (socket, G_IO_OUT, NULL, NULL);
+    else if (errno != EINTR)
+      break;
+  }
+
+  GST_WARNING ("Failed to send packet of %" G_GSIZE_FORMAT " bytes: %s", size,
+      g_strerror (errno));
+}
+
+// must be called with the batch lock held
+static void
+gst_discord_crypto_sink_batch_flush (GstDiscordcryptosinkBatch * batch)
+{
+  guint n = batch->n_messages;
+
+  if (n == 0)
+    return;
+
+#ifdef __linux__
+  gint fd = g_socket_get_fd (batch->socket);
+  guint sent = 0;
+
+  for (guint i = 0; i < n; i++) {
+    GstDiscordcryptosinkMessage *msg = &batch->messages[i];
+
+    batch->iovecs[i].iov_base = msg->data;
+    batch->iovecs[i].iov_len = msg->size;
+    memset (&batch->headers[i], 0, sizeof batch->headers[i]);
+    batch->headers[i].msg_hdr.msg_name = &msg->addr;
+    batch->headers[i].msg_hdr.msg_namelen = msg->addr_len;
+    batch->headers[i].msg_hdr.msg_iov = &batch->iovecs[i];
+    batch->headers[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (sent < n) {
+    int ret = sendmmsg (fd, batch->headers + sent, n - sent, 0);
+
+    if (ret >= 0) {
+      sent += ret;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      g_socket_condition_wait (batch->socket, G_IO_OUT, NULL, NULL);
+    } else if (errno != EINTR) {
+      // the message at sent is the one that failed, skip it
+      GST_WARNING ("Failed to send packet of %" G_GSIZE_FORMAT " bytes: %s",
+          batch->messages[sent].size, g_strerror (errno));
+      sent++;
+    }
+  }
+#else
+  for (guint i = 0; i < n; i++) {
+    GstDiscordcryptosinkMessage *msg = &batch->messages[i];
+    gst_discord_crypto_sink_send_one (batch->socket, msg->data, msg->size,
+        &msg->addr, msg->addr_len);
+  }
+#endif
+
+  batch->n_messages = 0;
+}
+
+static gpointer
+gst_discord_crypto_sink_batch_thread (gpointer data)
+{
+  GstDiscordcryptosinkBatch *batch = data;
+
+  g_mutex_lock (&batch->lock);
+  while (batch->running) {
+    gint64 end = g_get_monotonic_time () + batch->interval;
+
+    while (batch->running && g_get_monotonic_time () < end)
+      g_cond_wait_until (&batch->cond, &batch->lock, end);
+
+    gst_discord_crypto_sink_batch_flush (batch);
+  }
+  g_mutex_unlock (&batch->lock);
+
+  return NULL;
+}
+
+static GstDiscordcryptosinkBatch *
+gst_discord_crypto_sink_batch_acquire (GSocket * socket, guint interval)
+{
+  GstDiscordcryptosinkBatch *batch;
+
+  g_mutex_lock (&batches_lock);
+  if (!batches)
+    batches = g_hash_table_new (NULL, NULL);
+
+  batch = g_hash_table_lookup (batches, socket);
+  if (!batch) {
+    batch = g_new0 (GstDiscordcryptosinkBatch, 1);
+    batch->socket = g_object_ref (socket);
+    batch->interval = interval;
+    g_mutex_init (&batch->lock);
+    g_cond_init (&batch->cond);
+    batch->running = TRUE;
+    batch->thread = g_thread_new ("discordcryptosink", gst_discord_crypto_sink_batch_thread, batch);
+    g_hash_table_insert (batches, socket, batch);
+  }
+  batch->refcount++;
+  g_mutex_unlock (&batches_lock);
+
+  return batch;
+}
+
+static void
+gst_discord_crypto_sink_batch_release (GstDiscordcryptosinkBatch * batch)
+{
+  g_mutex_lock (&batches_lock);
+  if (--batch->refcount > 0) {
+    g_mutex_unlock (&batches_lock);
+    return;
+  }
+  g_hash_table_remove (batches, batch->socket);
+  g_mutex_unlock (&batches_lock);
+
+  // the thread sends whatever is left before it exits
+  g_mutex_lock (&batch->lock);
+  batch->running = FALSE;
+  g_cond_signal (&batch->cond);
+  g_mutex_unlock (&batch->lock);
+  g_thread_join (batch->thread);
+
+  g_mutex_clear (&batch->lock);
+  g_cond_clear (&batch->cond);
+  g_object_unref (batch->socket);
+  g_free (batch);
+}
+
+static void
+gst_discord_crypto_sink_batch_send (GstDiscordcryptosinkBatch * batch, const guint8 * data,
+    gsize size, const struct sockaddr_storage * addr, socklen_t addr_len)
+{
+  GstDiscordcryptosinkMessage *msg;
+
+  g_mutex_lock (&batch->lock);
+  if (batch->n_messages == BATCH_SIZE)
+    gst_discord_crypto_sink_batch_flush (batch);
+
+  msg = &batch->messages[batch->n_messages++];
+  memcpy (&msg->addr, addr, addr_len);
+  msg->addr_len = addr_len;
+  memcpy (msg->data, data, size);
+  msg->size = size;
+  g_mutex_unlock (&batch->lock);
+}
+
+static gboolean
+gst_discord_crypto_sink_start (GstBaseSink * bsink)
+{
+  GstDiscordcryptosink *sink = GST_DISCORDCRYPTOSINK (bsink);
+
+  GInetAddress *address = NULL;
+  GSocketAddress *sockaddr;
+  GError *err = NULL;
+
+  address = g_inet_address_new_from_string (sink->host);
+  if (!address) {
+    GResolver *resolver = g_resolver_get_default ();
+    GList *results = g_resolver_lookup_by_name (resolver, sink->host, NULL, &err);
+    g_object_unref (resolver);
+    if (!results) {
+      GST_ELEMENT_ERROR (sink, RESOURCE, NOT_FOUND,
+        (("Could not resolve %s"), sink->host), ("%s", err->message));
+      g_clear_error (&err);
+      return FALSE;
+    }
+    address = g_object_ref (results->data);
+    g_resolver_free_addresses (results);
+  }
+
+  sockaddr = g_inet_socket_address_new (address, sink->port);
+  sink->addr_len = g_socket_address_get_native_size (sockaddr);
+  if (!g_socket_address_to_native (sockaddr, &sink->addr, sizeof sink->addr, &err)) {
+    GST_ELEMENT_ERROR (sink, RESOURCE, SETTINGS, (NULL), ("%s", err->message));
+    g_clear_error (&err);
+    g_object_unref (sockaddr);
+    g_object_unref (address);
+    return FALSE;
+  }
+  g_object_unref (sockaddr);
+
+  if (sink->socket) {
+    sink->used_socket = g_object_ref (sink->socket);
+  } else {
+    sink->used_socket = g_socket_new (g_inet_address_get_family (address),
+        G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &err);
+    if (!sink->used_socket) {
+      GST_ELEMENT_ERROR (sink, RESOURCE, OPEN_WRITE, (NULL), ("%s", err->message));
+      g_clear_error (&err);
+      g_object_unref (address);
+      return FALSE;
+    }
+  }
+  g_object_unref (address);
+
+  if (sink->batch_interval > 0) {
+    sink->batch = gst_discord_crypto_sink_batch_acquire (sink->used_socket, sink->batch_interval);
+    GST_INFO_OBJECT (sink, "Batching packets every %u us", sink->batch->interval);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_discord_crypto_sink_stop (GstBaseSink * bsink)
+{
+  GstDiscordcryptosink *sink = GST_DISCORDCRYPTOSINK (bsink);
+
+  if (sink->batch) {
+    gst_discord_crypto_sink_batch_release (sink->batch);
+    sink->batch = NULL;
+  }
+  g_clear_object (&sink->used_socket);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_discord_crypto_sink_render (GstBaseSink * bsink, GstBuffer * buf)
+{
+  GstDiscordcryptosink *sink = GST_DISCORDCRYPTOSINK (bsink);
+
+  guint8 packet[MAX_PACKET_SIZE + MAX_TRAILER_SIZE];
+  // read once, the packet is sized and encrypted for the same mode
+  GstDiscordcryptoPattern encryption = g_atomic_int_get ((gint *) &sink->encryption);
+  gsize size = gst_buffer_get_size (buf);
+  gsize out_size = size + gst_discord_crypto_trailer_size (encryption);
+
+  if (size > MAX_PACKET_SIZE) {
+    GST_WARNING_OBJECT (sink, "Dropping packet of %" G_GSIZE_FORMAT " bytes, too large", size);
+    return GST_FLOW_OK;
+  }
+
+  // the buffer may be shared, encrypting a copy also leaves it alone
+  gst_buffer_extract (buf, 0, packet, size);
+
+  gsize header_size = gst_discord_crypto_header_size (packet, size,
+      gst_discord_crypto_is_rtpsize (encryption));
+  if (header_size == 0) {
+    GST_WARNING_OBJECT (sink, "Dropping invalid RTP packet of %" G_GSIZE_FORMAT " bytes", size);
+    return GST_FLOW_OK;
+  }
+
+  gint slot;
+  GstDiscordcryptoSession *session = gst_discord_crypto_keyring_acquire (&sink->keys, &slot);
+  gboolean encrypted = gst_discord_crypto_session_encrypt (session, encryption,
+      packet, header_size, size);
+  gst_discord_crypto_keyring_release (&sink->keys, slot);
+
+  if (!encrypted) {
+    GST_ELEMENT_ERROR (sink, STREAM, ENCODE,
+      (("Can't encrypt packet, no AES-256-GCM key set")), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  if (sink->batch)
+    gst_discord_crypto_sink_batch_send (sink->batch, packet, out_size, &sink->addr, sink->addr_len);
+  else
+    gst_discord_crypto_sink_send_one (sink->used_socket, packet, out_size, &sink->addr, sink->addr_len);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_discord_crypto_sink_render_list (GstBaseSink * bsink, GstBufferList * list)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint len = gst_buffer_list_length (list);
+
+  for (guint i = 0; i < len && ret == GST_FLOW_OK; i++)
+    ret = gst_discord_crypto_sink_render (bsink, gst_buffer_list_get (list, i));
+
+  return ret;
+}
@@ -0,0 +1,106 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDCRYPTOSINK_H__
+#define __GST_DISCORDCRYPTOSINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gio/gio.h>
+#include <sys/socket.h>
+
+#include "gstdiscordcryptosession.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DISCORDCRYPTOSINK \
+  (gst_discord_crypto_sink_get_type())
+#define GST_DISCORDCRYPTOSINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DISCORDCRYPTOSINK,GstDiscordcryptosink))
+#define GST_DISCORDCRYPTOSINK_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_DISCORDCRYPTOSINK,GstDiscordcryptosinkClass))
+#define GST_IS_DISCORDCRYPTOSINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_DISCORDCRYPTOSINK))
+#define GST_IS_DISCORDCRYPTOSINK_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_DISCORDCRYPTOSINK))
+
+typedef struct _GstDiscordcryptosink      GstDiscordcryptosink;
+typedef struct _GstDiscordcryptosinkClass GstDiscordcryptosinkClass;
+
+// packets queued on one socket, flushed with a single sendmmsg
+typedef struct _GstDiscordcryptosinkBatch GstDiscordcryptosinkBatch;
+
+struct _GstDiscordcryptosink
+{
+  GstBaseSink element;
+
+  GstDiscordcryptoPattern encryption;
+  GstDiscordcryptoKeyring keys;
+
+  gchar *host;
+  gint port;
+  guint batch_interval;
+
+  // socket set by the application, e.g. the one that did ip discovery
+  GSocket *socket;
+  // socket packets are sent on, owned if the application didn't set one
+  GSocket *used_socket;
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+
+  // shared with every sink batching on the same socket, NULL sends right away
+  GstDiscordcryptosinkBatch *batch;
+};
+
+struct _GstDiscordcryptosinkClass
+{
+  GstBaseSinkClass parent_class;
+};
+
+GType gst_discord_crypto_sink_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDCRYPTOSINK_H__ */
@@ -0,0 +1,123 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstdiscordcryptotracer.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_discord_crypto_tracer_debug);
+#define GST_CAT_DEFAULT gst_discord_crypto_tracer_debug
+
+gint gst_discord_crypto_tracers = 0;
+
+static GstTracerRecord *tr_latency;
+
+#define gst_discord_crypto_tracer_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstDiscordcryptoTracer, gst_discord_crypto_tracer, GST_TYPE_TRACER,
+    GST_DEBUG_CATEGORY_INIT (gst_discord_crypto_tracer_debug, "discordcrypto-latency", 0,
+        "discordcrypto latency tracer"));
+
+static void
+gst_discord_crypto_tracer_finalize (GObject * object)
+{
+  g_atomic_int_add (&gst_discord_crypto_tracers, -1);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static GstStructure *
+gst_discord_crypto_tracer_ns_field (const gchar * description)
+{
+  return gst_structure_new ("value",
+      "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+      "description", G_TYPE_STRING, description,
+      "min", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+      "max", G_TYPE_UINT64, G_MAXUINT64, NULL);
+}
+
+static void
+gst_discord_crypto_tracer_class_init (GstDiscordcryptoTracerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_discord_crypto_tracer_finalize;
+
+  tr_latency = gst_tracer_record_new ("discordcrypto-latency.class",
+      "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_ELEMENT,
+          NULL),
+      "pts", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "timestamp of the packet", NULL),
+      "buffer", GST_TYPE_STRUCTURE,
+          gst_discord_crypto_tracer_ns_field ("ns spent resizing and mapping the buffer"),
+      "crypto", GST_TYPE_STRUCTURE,
+          gst_discord_crypto_tracer_ns_field ("ns spent in the cipher"),
+      "total", GST_TYPE_STRUCTURE,
+          gst_discord_crypto_tracer_ns_field ("ns spent encrypting the packet"),
+      NULL);
+  GST_OBJECT_FLAG_SET (tr_latency, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void
+gst_discord_crypto_tracer_init (GstDiscordcryptoTracer * self)
+{
+  g_atomic_int_inc (&gst_discord_crypto_tracers);
+}
+
+void
+gst_discord_crypto_tracer_log (GstElement * element, GstBuffer * buf,
+    GstClockTime start, GstClockTime mapped, GstClockTime encrypted, GstClockTime end)
+{
+  gst_tracer_record_log (tr_latency, GST_OBJECT_NAME (element), GST_BUFFER_PTS (buf),
+      (guint64) ((mapped - start) + (end - encrypted)),
+      (guint64) (encrypted - mapped),
+      (guint64) (end - start));
+}
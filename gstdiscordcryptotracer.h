@@ -0,0 +1,97 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDCRYPTO_TRACER_H__
+#define __GST_DISCORDCRYPTO_TRACER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DISCORDCRYPTO_TRACER \
+  (gst_discord_crypto_tracer_get_type())
+#define GST_DISCORDCRYPTO_TRACER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DISCORDCRYPTO_TRACER,GstDiscordcryptoTracer))
+
+typedef struct _GstDiscordcryptoTracer      GstDiscordcryptoTracer;
+typedef struct _GstDiscordcryptoTracerClass GstDiscordcryptoTracerClass;
+
+/*
+ * discordcrypto-latency, splits the time a packet spends in the encrypter
+ * into resizing and mapping the buffer and the cipher itself. Enabled with
+ * GST_TRACERS=discordcrypto-latency, the element only takes timestamps
+ * while one exists.
+ */
+struct _GstDiscordcryptoTracer
+{
+  GstTracer parent;
+};
+
+struct _GstDiscordcryptoTracerClass
+{
+  GstTracerClass parent_class;
+};
+
+GType gst_discord_crypto_tracer_get_type (void);
+
+// number of live tracers, only read through gst_discord_crypto_tracer_enabled
+extern gint gst_discord_crypto_tracers;
+
+static inline gboolean
+gst_discord_crypto_tracer_enabled (void)
+{
+  return G_UNLIKELY (g_atomic_int_get (&gst_discord_crypto_tracers) > 0);
+}
+
+/*
+ * Logs one packet, start to mapped and encrypted to end are spent on the
+ * buffer, mapped to encrypted in the cipher.
+ */
+void gst_discord_crypto_tracer_log (GstElement * element, GstBuffer * buf,
+    GstClockTime start, GstClockTime mapped, GstClockTime encrypted, GstClockTime end);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDCRYPTO_TRACER_H__ */
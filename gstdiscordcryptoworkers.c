@@ -0,0 +1,252 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstdiscordcryptoworkers.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_discord_crypto_workers_debug);
+#define GST_CAT_DEFAULT gst_discord_crypto_workers_debug
+
+typedef struct {
+  GThread *thread;
+  gboolean running;
+
+  // intrusive MPSC queue, producers exchange head, only the worker touches tail
+  GstDiscordcryptoJob *head;
+  GstDiscordcryptoJob *tail;
+  GstDiscordcryptoJob stub;
+
+  // jobs submitted but not popped yet, the worker only sleeps at 0
+  gint pending;
+  GMutex lock;
+  GCond cond;
+} GstDiscordcryptoWorker;
+
+// fixed so submitting never races with the pool growing
+static GstDiscordcryptoWorker *workers[GST_DISCORDCRYPTO_MAX_WORKERS];
+
+static GMutex workers_lock;
+static guint n_workers;
+static guint workers_refcount;
+static guint next_worker;
+
+static void
+gst_discord_crypto_worker_push (GstDiscordcryptoWorker * worker, GstDiscordcryptoJob * job)
+{
+  GstDiscordcryptoJob *prev;
+
+  job->next = NULL;
+  prev = __atomic_exchange_n (&worker->head, job, __ATOMIC_ACQ_REL);
+  g_atomic_pointer_set (&prev->next, job);
+}
+
+// NULL if the queue is empty or a producer is half way through a push
+static GstDiscordcryptoJob *
+gst_discord_crypto_worker_pop (GstDiscordcryptoWorker * worker)
+{
+  GstDiscordcryptoJob *tail = worker->tail;
+  GstDiscordcryptoJob *next = g_atomic_pointer_get (&tail->next);
+
+  if (tail == &worker->stub) {
+    if (!next)
+      return NULL;
+    worker->tail = next;
+    tail = next;
+    next = g_atomic_pointer_get (&next->next);
+  }
+
+  if (next) {
+    worker->tail = next;
+    return tail;
+  }
+
+  if (tail != g_atomic_pointer_get (&worker->head))
+    return NULL;
+
+  gst_discord_crypto_worker_push (worker, &worker->stub);
+
+  next = g_atomic_pointer_get (&tail->next);
+  if (next) {
+    worker->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
+
+static gpointer
+gst_discord_crypto_worker_loop (gpointer data)
+{
+  GstDiscordcryptoWorker *worker = data;
+
+  for (;;) {
+    GstDiscordcryptoJob *job = gst_discord_crypto_worker_pop (worker);
+
+    if (job) {
+      g_atomic_int_add (&worker->pending, -1);
+      job->run (job);
+      continue;
+    }
+
+    // a push is in progress, it will be visible in a moment
+    if (g_atomic_int_get (&worker->pending) > 0) {
+      g_thread_yield ();
+      continue;
+    }
+
+    g_mutex_lock (&worker->lock);
+    while (g_atomic_int_get (&worker->pending) == 0 && worker->running)
+      g_cond_wait (&worker->cond, &worker->lock);
+    if (!worker->running && g_atomic_int_get (&worker->pending) == 0) {
+      g_mutex_unlock (&worker->lock);
+      break;
+    }
+    g_mutex_unlock (&worker->lock);
+  }
+
+  return NULL;
+}
+
+void
+gst_discord_crypto_workers_acquire (guint wanted)
+{
+  g_mutex_lock (&workers_lock);
+
+  if (!gst_discord_crypto_workers_debug) {
+    GST_DEBUG_CATEGORY_INIT (gst_discord_crypto_workers_debug, "discordcryptoworkers",
+        0, "discordcrypto shared workers");
+  }
+
+  workers_refcount++;
+  wanted = MIN (wanted, GST_DISCORDCRYPTO_MAX_WORKERS);
+
+  if (wanted > n_workers) {
+    for (guint i = n_workers; i < wanted; i++) {
+      GstDiscordcryptoWorker *worker = g_new0 (GstDiscordcryptoWorker, 1);
+      gchar *name = g_strdup_printf ("discordcrypto%u", i);
+
+      worker->running = TRUE;
+      worker->head = &worker->stub;
+      worker->tail = &worker->stub;
+      g_mutex_init (&worker->lock);
+      g_cond_init (&worker->cond);
+      worker->thread = g_thread_new (name, gst_discord_crypto_worker_loop, worker);
+      workers[i] = worker;
+
+      g_free (name);
+    }
+
+    GST_INFO ("Running %u crypto workers", wanted);
+    n_workers = wanted;
+  }
+
+  g_mutex_unlock (&workers_lock);
+}
+
+void
+gst_discord_crypto_workers_release (void)
+{
+  g_mutex_lock (&workers_lock);
+
+  if (--workers_refcount > 0) {
+    g_mutex_unlock (&workers_lock);
+    return;
+  }
+
+  // every element drained its jobs before releasing, the queues are empty
+  for (guint i = 0; i < n_workers; i++) {
+    GstDiscordcryptoWorker *worker = workers[i];
+
+    g_mutex_lock (&worker->lock);
+    worker->running = FALSE;
+    g_cond_signal (&worker->cond);
+    g_mutex_unlock (&worker->lock);
+
+    g_thread_join (worker->thread);
+    g_mutex_clear (&worker->lock);
+    g_cond_clear (&worker->cond);
+    g_free (worker);
+    workers[i] = NULL;
+  }
+
+  n_workers = 0;
+
+  g_mutex_unlock (&workers_lock);
+}
+
+guint
+gst_discord_crypto_workers_assign (void)
+{
+  guint worker;
+
+  g_mutex_lock (&workers_lock);
+  worker = next_worker++ % n_workers;
+  g_mutex_unlock (&workers_lock);
+
+  return worker;
+}
+
+void
+gst_discord_crypto_workers_submit (guint index, GstDiscordcryptoJob * job)
+{
+  // the pool never shrinks while it is referenced, no lock needed
+  GstDiscordcryptoWorker *worker = workers[index];
+
+  // counted before it is queued so the worker never sleeps on a queued job
+  gboolean idle = g_atomic_int_add (&worker->pending, 1) == 0;
+
+  gst_discord_crypto_worker_push (worker, job);
+
+  if (idle) {
+    g_mutex_lock (&worker->lock);
+    g_cond_signal (&worker->cond);
+    g_mutex_unlock (&worker->lock);
+  }
+}
@@ -0,0 +1,81 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDCRYPTO_WORKERS_H__
+#define __GST_DISCORDCRYPTO_WORKERS_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_DISCORDCRYPTO_MAX_WORKERS 64
+
+typedef struct _GstDiscordcryptoJob GstDiscordcryptoJob;
+
+/*
+ * Work item handed to the shared crypto workers. Embedded in the caller's
+ * own struct so submitting doesn't allocate, run on the worker thread.
+ */
+struct _GstDiscordcryptoJob
+{
+  GstDiscordcryptoJob *next;
+  void (*run) (GstDiscordcryptoJob * job);
+};
+
+/*
+ * Process wide pool of crypto threads shared by every element that asks
+ * for workers. Each worker owns a lock-free multi-producer queue and runs
+ * its jobs in submission order, so a stream that always submits to the
+ * same worker keeps its packet order.
+ */
+void gst_discord_crypto_workers_acquire (guint n_workers);
+void gst_discord_crypto_workers_release (void);
+
+guint gst_discord_crypto_workers_assign (void);
+void gst_discord_crypto_workers_submit (guint worker, GstDiscordcryptoJob * job);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDCRYPTO_WORKERS_H__ */
@@ -0,0 +1,549 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/** * SECTION:element-discorddecrypt
+ *
+ * Verifies and decrypts voice packets received from Discord so they can be
+ * depayloaded. Packets that fail authentication are dropped.
+ * 
+ * <refsect2>
+ * <title>Example of receiving with the key being obtained from Discord</title>
+ * |[
+ * gst-launch-1.0 -v udpsrc port=1234 caps="application/x-rtp,media=audio,clock-rate=48000,encoding-name=OPUS,payload=120,encoding-params=(string)2" ! \
+ *   discorddecrypt encryption=xsalsa20_poly1305_lite \
+ *   "key=<x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x,x>" ! \
+ *   rtpopusdepay ! opusdec ! autoaudiosink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include <gst/base/gstbasetransform.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include <sodium.h>
+
+#include "gstdiscorddecrypt.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_discord_decrypt_debug);
+#define GST_CAT_DEFAULT gst_discord_decrypt_debug
+
+// enough for a full 99 person channel without growing
+#define SSRC_TABLE_INITIAL_CAPACITY 128
+
+// counters are bumped on the streaming thread without the object lock and
+// read by the stats getter under it, so neither side may tear them
+#define STATS_ADD(counter) \
+  __atomic_add_fetch (&(counter), 1, __ATOMIC_RELAXED)
+#define STATS_GET(counter) \
+  __atomic_load_n (&(counter), __ATOMIC_RELAXED)
+
+enum
+{
+  SIGNAL_REKEY,
+  LAST_SIGNAL
+};
+
+enum
+{
+  PROP_0,
+  PROP_ENCRYPTION,
+  PROP_KEY,
+  PROP_STATS
+};
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp, "
+        "media = (string) \"audio\", "
+        "payload = (int) " GST_RTP_PAYLOAD_DYNAMIC_STRING ", "
+        "clock-rate = (int) 48000, "
+        "encoding-params = (string) \"2\", "
+        "encoding-name = (string) { \"OPUS\", \"X-GST-OPUS-DRAFT-SPITTKA-00\" }")
+    );
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp, "
+        "media = (string) \"audio\", "
+        "payload = (int) " GST_RTP_PAYLOAD_DYNAMIC_STRING ", "
+        "clock-rate = (int) 48000, "
+        "encoding-params = (string) \"2\", "
+        "encoding-name = (string) { \"OPUS\", \"X-GST-OPUS-DRAFT-SPITTKA-00\" }")
+    );
+
+static guint gst_discord_decrypt_signals[LAST_SIGNAL] = { 0 };
+
+#define gst_discord_decrypt_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstDiscorddecrypt, gst_discord_decrypt, GST_TYPE_BASE_TRANSFORM,
+    GST_DEBUG_CATEGORY_INIT (gst_discord_decrypt_debug, "discorddecrypt", 0, "discorddecrypt"));
+
+static void gst_discord_decrypt_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_discord_decrypt_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_discord_decrypt_finalize (GObject * object);
+static gboolean gst_discord_decrypt_rekey (GstDiscorddecrypt * filter, GBytes * key);
+static GstFlowReturn gst_discord_decrypt_transform_ip (GstBaseTransform * base, GstBuffer *buf);
+
+static gboolean gst_discord_decrypt_start (GstBaseTransform * base);
+static gboolean gst_discord_decrypt_stop (GstBaseTransform * base);
+
+static void
+gst_discord_decrypt_class_init (GstDiscorddecryptClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->set_property = gst_discord_decrypt_set_property;
+  gobject_class->get_property = gst_discord_decrypt_get_property;
+  gobject_class->finalize = gst_discord_decrypt_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_ENCRYPTION,
+      g_param_spec_enum ("encryption", "Encryption", "type of encryption to use",
+       GST_TYPE_DISCORDCRYPTO_PATTERN, GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(gobject_class, PROP_KEY,
+      gst_param_spec_array("key", "Key", "secret key from discord",
+         g_param_spec_uint("value", "val", "val", 0, 255, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS),
+         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_LAX_VALIDATION));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics", "per ssrc packet, drop and replay counters",
+       GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstDiscorddecrypt::rekey:
+   * @key: (transfer none): the new 32 byte secret key
+   *
+   * Switches to a new key between two packets without stalling the stream.
+   * Returns FALSE if the key is too short.
+   */
+  gst_discord_decrypt_signals[SIGNAL_REKEY] =
+      g_signal_new ("rekey", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstDiscorddecryptClass, rekey), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 1, G_TYPE_BYTES);
+
+  klass->rekey = gst_discord_decrypt_rekey;
+
+  gst_element_class_set_details_simple(gstelement_class,
+    "Discord Voice Decrypter",
+    "Decryption/Audio",
+    "Decrypts opus data received from Discord",
+    "<<user@hostname.org>>");
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_factory));
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_factory));
+
+  GST_BASE_TRANSFORM_CLASS (klass)->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_discord_decrypt_transform_ip);
+
+  GST_BASE_TRANSFORM_CLASS (klass)->start =
+      GST_DEBUG_FUNCPTR (gst_discord_decrypt_start);
+
+  GST_BASE_TRANSFORM_CLASS (klass)->stop =
+      GST_DEBUG_FUNCPTR (gst_discord_decrypt_stop);
+}
+
+static void
+gst_discord_decrypt_init (GstDiscorddecrypt * filter)
+{
+  filter->encryption = GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE;
+  gst_discord_crypto_keyring_init (&filter->keys);
+}
+
+static void
+gst_discord_decrypt_finalize (GObject * object)
+{
+  GstDiscorddecrypt *filter = GST_DISCORDDECRYPT (object);
+
+  g_free (filter->ssrcs);
+  gst_discord_crypto_keyring_clear (&filter->keys);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static inline guint
+gst_discord_decrypt_ssrc_hash (guint32 ssrc)
+{
+  // ssrcs handed out by Discord are close together, spread them out
+  guint32 h = ssrc * 2654435761u;
+  return h ^ (h >> 16);
+}
+
+static GstDiscorddecryptSsrc *
+gst_discord_decrypt_find_ssrc (GstDiscorddecrypt * filter, guint32 ssrc)
+{
+  if (!filter->ssrcs)
+    return NULL;
+
+  guint mask = filter->ssrcs_capacity - 1;
+
+  // the load factor stays below 3/4 so there always is an unused slot
+  for (guint i = gst_discord_decrypt_ssrc_hash (ssrc) & mask;
+      filter->ssrcs[i].used; i = (i + 1) & mask) {
+    if (filter->ssrcs[i].ssrc == ssrc)
+      return &filter->ssrcs[i];
+  }
+
+  return NULL;
+}
+
+static GstDiscorddecryptSsrc *
+gst_discord_decrypt_free_slot (GstDiscorddecryptSsrc * ssrcs, guint capacity, guint32 ssrc)
+{
+  guint mask = capacity - 1;
+  guint i = gst_discord_decrypt_ssrc_hash (ssrc) & mask;
+
+  while (ssrcs[i].used)
+    i = (i + 1) & mask;
+
+  return &ssrcs[i];
+}
+
+// only called for ssrcs that aren't in the table yet and authenticated a packet
+static GstDiscorddecryptSsrc *
+gst_discord_decrypt_add_ssrc (GstDiscorddecrypt * filter, guint32 ssrc)
+{
+  GstDiscorddecryptSsrc *entry;
+
+  GST_OBJECT_LOCK (filter);
+
+  if ((filter->n_ssrcs + 1) * 4 > filter->ssrcs_capacity * 3) {
+    GstDiscorddecryptSsrc *old = filter->ssrcs;
+    guint old_capacity = filter->ssrcs_capacity;
+    guint capacity = old_capacity ? old_capacity * 2 : SSRC_TABLE_INITIAL_CAPACITY;
+
+    filter->ssrcs = g_new0 (GstDiscorddecryptSsrc, capacity);
+    filter->ssrcs_capacity = capacity;
+
+    for (guint i = 0; i < old_capacity; i++) {
+      if (old[i].used)
+        *gst_discord_decrypt_free_slot (filter->ssrcs, capacity, old[i].ssrc) = old[i];
+    }
+    g_free (old);
+  }
+
+  entry = gst_discord_decrypt_free_slot (filter->ssrcs, filter->ssrcs_capacity, ssrc);
+  memset (entry, 0, sizeof (*entry));
+  entry->ssrc = ssrc;
+  entry->used = TRUE;
+  filter->n_ssrcs++;
+
+  GST_OBJECT_UNLOCK (filter);
+
+  GST_DEBUG_OBJECT (filter, "New ssrc %u, %u tracked", ssrc, filter->n_ssrcs);
+
+  return entry;
+}
+
+static void
+gst_discord_decrypt_reset_ssrcs (GstDiscorddecrypt * filter)
+{
+  GST_OBJECT_LOCK (filter);
+  for (guint i = 0; i < filter->ssrcs_capacity; i++)
+    filter->ssrcs[i].has_nonce = FALSE;
+  GST_OBJECT_UNLOCK (filter);
+}
+
+// only the lite and rtpsize modes use a counter that can be checked for replays
+static inline gboolean
+gst_discord_decrypt_has_counter_nonce (GstDiscordcryptoPattern encryption)
+{
+  return encryption == GST_DISCORDCRYPTO_XSALSA20_POLY1305_LITE ||
+      gst_discord_crypto_is_rtpsize (encryption);
+}
+
+// whether a counter nonce hasn't been seen from this ssrc yet
+static gboolean
+gst_discord_decrypt_replay_check (const GstDiscorddecryptSsrc * entry, guint32 nonce)
+{
+  if (!entry || !entry->has_nonce)
+    return TRUE;
+
+  gint32 delta = (gint32) (nonce - entry->last_nonce);
+  if (delta > 0)
+    return TRUE;
+
+  guint64 behind = (guint64) (-(gint64) delta);
+  if (behind >= REPLAY_WINDOW_SIZE)
+    return FALSE;
+
+  return !(entry->replay_window & (G_GUINT64_CONSTANT (1) << behind));
+}
+
+static void
+gst_discord_decrypt_replay_update (GstDiscorddecryptSsrc * entry, guint32 nonce)
+{
+  if (!entry->has_nonce) {
+    entry->has_nonce = TRUE;
+    entry->last_nonce = nonce;
+    entry->replay_window = 1;
+    return;
+  }
+
+  gint32 delta = (gint32) (nonce - entry->last_nonce);
+  if (delta > 0) {
+    entry->replay_window = delta >= REPLAY_WINDOW_SIZE ? 0 : entry->replay_window << delta;
+    entry->replay_window |= 1;
+    entry->last_nonce = nonce;
+  } else {
+    entry->replay_window |= G_GUINT64_CONSTANT (1) << (guint64) (-(gint64) delta);
+  }
+}
+
+static GstStructure *
+gst_discord_decrypt_create_stats (GstDiscorddecrypt * filter)
+{
+  GstStructure *stats;
+  GValue ssrcs = G_VALUE_INIT;
+
+  g_value_init (&ssrcs, GST_TYPE_ARRAY);
+
+  GST_OBJECT_LOCK (filter);
+  for (guint i = 0; i < filter->ssrcs_capacity; i++) {
+    GstDiscorddecryptSsrc *entry = &filter->ssrcs[i];
+    GValue val = G_VALUE_INIT;
+
+    if (!entry->used)
+      continue;
+
+    g_value_init (&val, GST_TYPE_STRUCTURE);
+    g_value_take_boxed (&val, gst_structure_new ("application/x-discorddecrypt-ssrc-stats",
+          "ssrc", G_TYPE_UINT, entry->ssrc,
+          "packets", G_TYPE_UINT64, STATS_GET (entry->packets),
+          "dropped", G_TYPE_UINT64, STATS_GET (entry->dropped),
+          "replayed", G_TYPE_UINT64, STATS_GET (entry->replayed),
+          "last-nonce", G_TYPE_UINT, entry->last_nonce, NULL));
+    gst_value_array_append_and_take_value (&ssrcs, &val);
+  }
+
+  stats = gst_structure_new ("application/x-discorddecrypt-stats",
+      "num-ssrcs", G_TYPE_UINT, filter->n_ssrcs,
+      "dropped", G_TYPE_UINT64, STATS_GET (filter->dropped), NULL);
+  GST_OBJECT_UNLOCK (filter);
+
+  gst_structure_take_value (stats, "ssrc-stats", &ssrcs);
+
+  return stats;
+}
+
+static gboolean
+gst_discord_decrypt_rekey (GstDiscorddecrypt * filter, GBytes * key)
+{
+  if (!gst_discord_crypto_keyring_set_key_bytes (&filter->keys, key)) {
+    GST_WARNING_OBJECT (filter, "Ignoring rekey, the key is too short");
+    return FALSE;
+  }
+
+  // nonces start over with a new key
+  g_atomic_int_set (&filter->reset_ssrcs, TRUE);
+  GST_INFO_OBJECT (filter, "Switched to a new key");
+  return TRUE;
+}
+
+static void
+gst_discord_decrypt_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDiscorddecrypt *filter = GST_DISCORDDECRYPT (object);
+
+  switch (prop_id) {
+    case PROP_ENCRYPTION:
+      filter->encryption = g_value_get_enum (value);
+      break;
+    case PROP_KEY:
+      if (!gst_discord_crypto_keyring_set_key (&filter->keys, value)) {
+        GST_ELEMENT_ERROR (filter, LIBRARY, INIT,
+          (("Specifed key too short")), (NULL));
+        return;
+      }
+      // nonces start over with a new key
+      g_atomic_int_set (&filter->reset_ssrcs, TRUE);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_discord_decrypt_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstDiscorddecrypt *filter = GST_DISCORDDECRYPT (object);
+
+  switch (prop_id) {
+    case PROP_ENCRYPTION:
+      g_value_set_enum (value, filter->encryption);
+      break;
+    case PROP_KEY:
+      gst_discord_crypto_keyring_get_key (&filter->keys, value);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_discord_decrypt_create_stats (filter));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static GstFlowReturn
+gst_discord_decrypt_transform_ip (GstBaseTransform * base, GstBuffer *buf)
+{
+  GstDiscorddecrypt *filter = GST_DISCORDDECRYPT (base);
+
+  GstDiscorddecryptSsrc *entry;
+  GstMapInfo map;
+  gsize out_size;
+  guint32 nonce = 0;
+
+  if (G_UNLIKELY (g_atomic_int_compare_and_exchange (&filter->reset_ssrcs, TRUE, FALSE)))
+    gst_discord_decrypt_reset_ssrcs (filter);
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READWRITE))
+    return GST_FLOW_ERROR;
+
+  gsize header_size = gst_discord_crypto_header_size (map.data, map.size,
+      gst_discord_crypto_is_rtpsize (filter->encryption));
+  if (header_size == 0 || map.size < header_size + 4) {
+    STATS_ADD (filter->dropped);
+    goto drop;
+  }
+
+  guint32 ssrc = GST_READ_UINT32_BE (map.data + 8);
+  entry = gst_discord_decrypt_find_ssrc (filter, ssrc);
+
+  // a replayed counter is rejected before paying for the tag check
+  gboolean counted = gst_discord_decrypt_has_counter_nonce (filter->encryption);
+  if (counted) {
+    nonce = GST_READ_UINT32_BE (map.data + (map.size - 4));
+    if (!gst_discord_decrypt_replay_check (entry, nonce)) {
+      STATS_ADD (entry->replayed);
+      goto drop;
+    }
+  }
+
+  gint slot;
+  GstDiscordcryptoSession *session = gst_discord_crypto_keyring_acquire (&filter->keys, &slot);
+  gboolean decrypted = gst_discord_crypto_session_decrypt (session, filter->encryption,
+      map.data, header_size, map.size, &out_size);
+  gst_discord_crypto_keyring_release (&filter->keys, slot);
+
+  if (!decrypted) {
+    if (entry)
+      STATS_ADD (entry->dropped);
+    else
+      STATS_ADD (filter->dropped);
+    goto drop;
+  }
+
+  gst_buffer_unmap (buf, &map);
+
+  // forged packets never get this far, so they can't fill the table
+  if (!entry)
+    entry = gst_discord_decrypt_add_ssrc (filter, ssrc);
+  if (counted)
+    gst_discord_decrypt_replay_update (entry, nonce);
+  STATS_ADD (entry->packets);
+
+  // only ever shrinks, the memory stays where it is
+  gst_buffer_set_size (buf, out_size);
+
+  return GST_FLOW_OK;
+
+drop:
+  GST_LOG_OBJECT (filter, "Dropping packet of %" G_GSIZE_FORMAT " bytes", map.size);
+  gst_buffer_unmap (buf, &map);
+  return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
+
+static gboolean
+gst_discord_decrypt_start (GstBaseTransform * base)
+{
+  GstDiscorddecrypt *filter = GST_DISCORDDECRYPT (base);
+
+  if (filter->encryption == GST_DISCORDCRYPTO_AEAD_AES256_GCM_RTPSIZE &&
+      !gst_discord_crypto_has_gcm ()) {
+    GST_ELEMENT_ERROR (filter, LIBRARY, INIT,
+      (("AES-256-GCM is not supported by this CPU")), (NULL));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_discord_decrypt_stop (GstBaseTransform * base)
+{
+  GstDiscorddecrypt *filter = GST_DISCORDDECRYPT (base);
+
+  GST_OBJECT_LOCK (filter);
+  g_free (filter->ssrcs);
+  filter->ssrcs = NULL;
+  filter->ssrcs_capacity = 0;
+  filter->n_ssrcs = 0;
+  __atomic_store_n (&filter->dropped, 0, __ATOMIC_RELAXED);
+  GST_OBJECT_UNLOCK (filter);
+
+  return TRUE;
+}
@@ -0,0 +1,121 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020  <<user@hostname.org>>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DISCORDDECRYPT_H__
+#define __GST_DISCORDDECRYPT_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+#include "gstdiscordcryptosession.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DISCORDDECRYPT \
+  (gst_discord_decrypt_get_type())
+#define GST_DISCORDDECRYPT(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DISCORDDECRYPT,GstDiscorddecrypt))
+#define GST_DISCORDDECRYPT_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_DISCORDDECRYPT,GstDiscorddecryptClass))
+#define GST_IS_DISCORDDECRYPT(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_DISCORDDECRYPT))
+#define GST_IS_DISCORDDECRYPT_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_DISCORDDECRYPT))
+
+typedef struct _GstDiscorddecrypt      GstDiscorddecrypt;
+typedef struct _GstDiscorddecryptClass GstDiscorddecryptClass;
+
+// packets older than this many counter nonces behind the newest are dropped
+#define REPLAY_WINDOW_SIZE 64
+
+/* One speaker on the socket. Slots live inline in an open addressed table,
+ * an unused slot has used == FALSE. */
+typedef struct {
+  guint32 ssrc;
+  gboolean used;
+
+  // newest authenticated counter nonce, bit n of the window is nonce - n
+  gboolean has_nonce;
+  guint32 last_nonce;
+  guint64 replay_window;
+
+  guint64 packets;
+  guint64 dropped;
+  guint64 replayed;
+} GstDiscorddecryptSsrc;
+
+struct _GstDiscorddecrypt
+{
+  GstBaseTransform element;
+
+  GstDiscordcryptoPattern encryption;
+
+  // keys are swapped without stopping the stream
+  GstDiscordcryptoKeyring keys;
+
+  // capacity is always a power of two, only grown on the streaming thread
+  // and under the object lock
+  GstDiscorddecryptSsrc *ssrcs;
+  guint ssrcs_capacity;
+  guint n_ssrcs;
+  // packets that didn't parse or verify before an ssrc could be trusted
+  guint64 dropped;
+  // set when the key changes, the streaming thread then forgets all nonces
+  gint reset_ssrcs;
+};
+
+struct _GstDiscorddecryptClass
+{
+  GstBaseTransformClass parent_class;
+
+  /* actions */
+  gboolean (*rekey) (GstDiscorddecrypt * filter, GBytes * key);
+};
+
+GType gst_discord_decrypt_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_DISCORDDECRYPT_H__ */